@@ -0,0 +1,186 @@
+#include "ContextIndex.h"
+#include <algorithm>
+#include <bitset>
+
+ContextIndex::ContextIndex()
+{
+    setIgnored("");
+}
+
+/**
+ * Sets the symbols that are skipped when looking for context.
+ * @brief ContextIndex::setIgnored
+ * @param symbols every character is an ignored symbol
+ */
+void ContextIndex::setIgnored(const std::string &symbols) {
+    std::fill(m_ignored, m_ignored + 256, false);
+    for (char c : symbols) {
+        m_ignored[static_cast<unsigned char>(c)] = true;
+    }
+}
+
+/**
+ * Matches the brackets of a generation in one pass, with a stack of the brackets still open.
+ * @brief ContextIndex::build
+ * @param sequence generation to index
+ */
+void ContextIndex::build(const PackedSequence &sequence) {
+    const size_t length = sequence.size();
+    m_brackets.assign((length + 63) / 64, 0);
+    m_rank.assign(m_brackets.size(), 0);
+    m_partners.clear();
+
+    struct Open {
+        uint32_t bracket; // index into m_partners
+        int32_t position;
+    };
+    std::vector<Open> stack;
+
+    size_t i = 0;
+    for (PackedSequence::const_iterator it = sequence.begin(); it != sequence.end(); ++it, i++) {
+        if (i % 64 == 0) {
+            m_rank[i / 64] = m_partners.size();
+        }
+        char c = *it;
+        if (c != '[' && c != ']') {
+            continue;
+        }
+        m_brackets[i / 64] |= uint64_t(1) << (i % 64);
+        if (c == '[') {
+            stack.push_back({ static_cast<uint32_t>(m_partners.size()), static_cast<int32_t>(i) });
+            m_partners.push_back(-1);
+        } else if (stack.empty()) {
+            m_partners.push_back(-1); // unbalanced, treat as a plain separator
+        } else {
+            m_partners[stack.back().bracket] = i;
+            m_partners.push_back(stack.back().position);
+            stack.pop_back();
+        }
+    }
+}
+
+/**
+ * Frees the index.
+ * @brief ContextIndex::clear
+ */
+void ContextIndex::clear() {
+    std::vector<uint64_t>().swap(m_brackets);
+    std::vector<uint32_t>().swap(m_rank);
+    std::vector<int32_t>().swap(m_partners);
+}
+
+/**
+ * Returns the memory the index holds.
+ * @brief ContextIndex::bytes
+ */
+size_t ContextIndex::bytes() const {
+    return m_brackets.size() * sizeof(uint64_t) + m_rank.size() * sizeof(uint32_t) +
+            m_partners.size() * sizeof(int32_t);
+}
+
+/**
+ * Returns the position of the bracket matching the bracket at i, or -1 if it has none.
+ * @brief ContextIndex::partner
+ */
+int32_t ContextIndex::partner(size_t i) const {
+    uint64_t before = m_brackets[i / 64] & ((uint64_t(1) << (i % 64)) - 1);
+    return m_partners[m_rank[i / 64] + std::bitset<64>(before).count()];
+}
+
+/**
+ * Finds the left context of the symbol at i, jumping from the end of every sub-branch on the way
+ * back to its start.
+ * @brief ContextIndex::left
+ */
+int32_t ContextIndex::left(const PackedSequence &sequence, size_t i) const {
+    if (isBracket(i) || isIgnored(sequence.at(i))) {
+        return -1;
+    }
+    for (size_t j = i; j-- > 0;) {
+        if (isBracket(j)) {
+            int32_t open = partner(j);
+            if (sequence.at(j) == ']' && open >= 0) {
+                j = open;
+            }
+        } else if (!isIgnored(sequence.at(j))) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Finds the right context of the symbol at i, jumping from the start of every sub-branch on the
+ * way to its end.
+ * @brief ContextIndex::right
+ */
+int32_t ContextIndex::right(const PackedSequence &sequence, size_t i) const {
+    if (isBracket(i) || isIgnored(sequence.at(i))) {
+        return -1;
+    }
+    for (size_t j = i + 1; j < sequence.size(); j++) {
+        if (isBracket(j)) {
+            int32_t other = partner(j);
+            if (sequence.at(j) == '[') {
+                if (other < 0) {
+                    return -1; // the branch never closes
+                }
+                j = other;
+            } else if (other >= 0) {
+                return -1; // end of the branch
+            }
+        } else if (!isIgnored(sequence.at(j))) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Finds the left context of the symbol at i by walking backwards through the sequence.
+ * @brief ContextIndex::scanLeft
+ */
+int32_t ContextIndex::scanLeft(const PackedSequence &sequence, size_t i) const {
+    if (sequence.at(i) == '[' || sequence.at(i) == ']' || isIgnored(sequence.at(i))) {
+        return -1;
+    }
+    int depth = 0;
+    for (size_t j = i; j-- > 0;) {
+        char c = sequence.at(j);
+        if (c == ']') {
+            depth++;
+        } else if (c == '[') {
+            if (depth > 0) {
+                depth--;
+            }
+        } else if (depth == 0 && !isIgnored(c)) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Finds the right context of the symbol at i by walking forwards through the sequence.
+ * @brief ContextIndex::scanRight
+ */
+int32_t ContextIndex::scanRight(const PackedSequence &sequence, size_t i) const {
+    if (sequence.at(i) == '[' || sequence.at(i) == ']' || isIgnored(sequence.at(i))) {
+        return -1;
+    }
+    int depth = 0;
+    for (size_t j = i + 1; j < sequence.size(); j++) {
+        char c = sequence.at(j);
+        if (c == '[') {
+            depth++;
+        } else if (c == ']') {
+            if (depth == 0) {
+                return -1;
+            }
+            depth--;
+        } else if (depth == 0 && !isIgnored(c)) {
+            return j;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,55 @@
+#ifndef CONTEXTINDEX_H
+#define CONTEXTINDEX_H
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "PackedSequence.h"
+
+/**
+ * Left and right context of the symbols of one L-system generation.
+ *
+ * Context follows the branching structure: the left context of a symbol is the symbol before it
+ * on the path from the root, so whole sub-branches to its left are skipped and a symbol at the start
+ * of a branch sees the symbol the branch grows from. The right context is the next symbol on the
+ * same branch after skipping whole sub-branches, and there is none at the end of a branch. Ignored
+ * symbols (typically turtle turns) are skipped as well and have no context themselves.
+ *
+ * build() matches the brackets with a stack in a single pass over the sequence and keeps only the
+ * bracket pairs: a bit per symbol marks the brackets, with a running count every 64 symbols, and
+ * each bracket stores the position of its partner. That is about 0.2 bytes per symbol plus 4 per
+ * bracket, next to the half byte per symbol of the packed sequence. left() and right() walk the
+ * sequence like scanLeft() and scanRight() do, but jump over a whole sub-branch in one step, so
+ * they only visit the ignored symbols and the brackets of the branch itself. scanLeft() and
+ * scanRight() walk every symbol and are kept as the reference implementation.
+ */
+class ContextIndex
+{
+public:
+    ContextIndex();
+
+    void setIgnored(const std::string &symbols);
+    bool isIgnored(char symbol) const { return m_ignored[static_cast<unsigned char>(symbol)]; }
+
+    void build(const PackedSequence &sequence);
+    void clear();
+
+    // Positions of the context symbols of the symbol at i, -1 if there is none. The sequence is
+    // the one the index was built from.
+    int32_t left(const PackedSequence &sequence, size_t i) const;
+    int32_t right(const PackedSequence &sequence, size_t i) const;
+    size_t bytes() const;
+
+    int32_t scanLeft(const PackedSequence &sequence, size_t i) const;
+    int32_t scanRight(const PackedSequence &sequence, size_t i) const;
+
+private:
+    bool isBracket(size_t i) const { return (m_brackets[i / 64] >> (i % 64)) & 1; }
+    int32_t partner(size_t i) const;
+
+    bool m_ignored[256];
+    std::vector<uint64_t> m_brackets;  // a bit per symbol, set for '[' and ']'
+    std::vector<uint32_t> m_rank;      // number of brackets before each word of m_brackets
+    std::vector<int32_t> m_partners;   // position of the partner of every bracket in order, -1 if unmatched
+};
+
+#endif // CONTEXTINDEX_H
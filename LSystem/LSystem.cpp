@@ -1,94 +1,360 @@
 #include "LSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
-#include <random>
+#include <thread>
+
+// Shorter generations are not worth the cost of starting threads.
+const size_t LSystem::PARALLEL_MIN_LENGTH = 1 << 15;
+// Extra chunks smooth out the uneven growth of different parts of the string.
+const int LSystem::CHUNKS_PER_THREAD = 4;
 
 LSystem::LSystem():
     m_recursions(2),
-    m_sequence("X")
+    m_threads(1),
+    m_hasContextRules(false),
+    m_axiom("X")
 {
-
+    std::fill(m_contextMaxLength, m_contextMaxLength + 256, 0);
+    setAxiom(m_axiom);
 }
 
 /**
- * Generates the string sequence based on the number of recursions.
+ * Generates the string sequence based on the number of recursions, starting over from the axiom.
+ * The time and output size of every pass are recorded and can be read back with getGenerationStats().
+ * The sequence is stored at 4 bits per symbol when the axiom and rules use at most 16 symbols.
  * @brief LSystem::generateSequence
  */
 void LSystem::generateSequence(){
+    std::vector<char> symbols = alphabet();
+    m_sequence.setAlphabet(symbols);
+    m_sequence.assign(m_axiom);
+    m_nextSequence.setAlphabet(symbols);
+    m_stats.clear();
+    m_stats.reserve(m_recursions);
     for (int i = 0; i < m_recursions; i++){
-        expand();
+        auto start = std::chrono::steady_clock::now();
+        if (m_hasContextRules) {
+            m_context.build(m_sequence);
+        }
+        if (m_threads > 1 && m_sequence.size() >= PARALLEL_MIN_LENGTH) {
+            expandParallel(i);
+        } else {
+            expand(i);
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        m_stats.push_back({ i + 1, m_sequence.size(), m_sequence.bytes(), elapsed.count() });
     }
+    m_context.clear();
 }
 
 /**
- * Expands the string using the rules in the map.
+ * Expands the string using the rule table. Each pass is written into the back buffer, which
+ * is sized up front from the longest replacement of every symbol, and then swapped with the
+ * sequence, so a pass is linear in the length of its output.
  * @brief LSystem::expand
+ * @param generation 0-based index of the pass, used to key stochastic choices
+ */
+void LSystem::expand(int generation){
+    size_t upperBound = 0;
+    for (char c : m_sequence) {
+        upperBound += maxReplacementLength(c);
+    }
+    m_nextSequence.resize(upperBound);
+
+    size_t length = writeRange(generation, 0, m_sequence.size(), m_nextSequence, 0, nullptr);
+    m_nextSequence.resize(length);
+    m_sequence.swap(m_nextSequence);
+}
+
+/**
+ * Expands the string on several threads. The sequence is split into chunks, the output length of
+ * every chunk is measured concurrently, a prefix sum over those lengths gives each chunk its place
+ * in the back buffer, and the chunks are then written concurrently. Stochastic choices are keyed on
+ * the symbol position, so the result is the same as expand() at any thread count. A packed chunk
+ * that starts at an odd position shares its first byte with the chunk before it, so its first
+ * symbol is held back and written once all threads are done.
+ * @brief LSystem::expandParallel
+ * @param generation 0-based index of the pass, used to key stochastic choices
+ */
+void LSystem::expandParallel(int generation){
+    const size_t length = m_sequence.size();
+    const int chunks = m_threads * CHUNKS_PER_THREAD;
+    std::vector<size_t> offsets(chunks + 1, 0);
+
+    auto runChunks = [&](auto work) {
+        std::atomic<int> nextChunk(0);
+        auto worker = [&]() {
+            for (int c = nextChunk++; c < chunks; c = nextChunk++) {
+                work(c, length * c / chunks, length * (c + 1) / chunks);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int t = 1; t < m_threads; t++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    };
+
+    runChunks([&](int c, size_t begin, size_t end) {
+        offsets[c + 1] = measureRange(generation, begin, end);
+    });
+    for (int c = 0; c < chunks; c++) {
+        offsets[c + 1] += offsets[c];
+    }
+
+    m_nextSequence.resize(offsets[chunks]);
+    const bool packed = m_nextSequence.isPacked();
+    std::vector<char> deferred(chunks, 0);
+    runChunks([&](int c, size_t begin, size_t end) {
+        writeRange(generation, begin, end, m_nextSequence, offsets[c], packed ? &deferred[c] : nullptr);
+    });
+    for (int c = 0; c < chunks; c++) {
+        if (packed && (offsets[c] & 1) && offsets[c + 1] > offsets[c]) {
+            m_nextSequence.set(offsets[c], deferred[c]);
+        }
+    }
+    m_sequence.swap(m_nextSequence);
+}
+
+/**
+ * Returns the number of symbols the given range of the sequence expands to.
+ * @brief LSystem::measureRange
  */
-void LSystem::expand(){
-    std::string currCharacter = "";
-    int sequenceLength = m_sequence.length();
-    int currCharIndex = 0;
-    while(currCharIndex < sequenceLength){
-        currCharacter = m_sequence.at(currCharIndex);
-        std::vector<std::string> replacements;
-        if (m_rules.count(currCharacter)){
-            replacements = m_rules.find(currCharacter)->second;
-            int replacementIndex = getReplacementIndex(replacements.size() - 1);
-            m_sequence.replace(currCharIndex, 1, replacements[replacementIndex]);
-            sequenceLength += replacements[replacementIndex].length()-1;
-            currCharIndex += replacements[replacementIndex].length();
+size_t LSystem::measureRange(int generation, size_t begin, size_t end) const {
+    size_t length = 0;
+    for (size_t i = begin; i < end; i++) {
+        RuleSpan replacement;
+        length += findReplacement(generation, i, m_sequence.at(i), replacement) ? replacement.length : 1;
+    }
+    return length;
+}
+
+/**
+ * Writes the expansion of the given range of the sequence to out, starting at the given position.
+ * @brief LSystem::writeRange
+ * @param deferred if not null and position is odd, receives the first symbol instead of out (see PackedSequence::Writer)
+ * @return one past the position of the last symbol written
+ */
+size_t LSystem::writeRange(int generation, size_t begin, size_t end, PackedSequence &out, size_t position, char *deferred) const {
+    PackedSequence::Writer writer(out, position, deferred);
+    for (size_t i = begin; i < end; i++) {
+        char c = m_sequence.at(i);
+        RuleSpan replacement;
+        if (findReplacement(generation, i, c, replacement)){
+            for (size_t k = 0; k < replacement.length; k++) {
+                writer.put(replacement.data[k]);
+            }
         } else {
-            currCharIndex += 1;
+            writer.put(c);
+        }
+    }
+    return writer.finish();
+}
+
+/**
+ * Finds the replacement of the symbol at position i of the sequence. The first context-sensitive
+ * rule of the symbol whose context matches wins; otherwise the context-free rules apply.
+ * @brief LSystem::findReplacement
+ * @param generation 0-based index of the pass being expanded
+ * @param i position of the symbol in the current sequence
+ * @param c the symbol at that position
+ * @param replacement set to the replacement if there is one
+ * @return false if the symbol is copied unchanged
+ */
+bool LSystem::findReplacement(int generation, size_t i, char c, RuleSpan &replacement) const {
+    const std::vector<ContextRule> &contextRules = m_contextRules[static_cast<unsigned char>(c)];
+    if (!contextRules.empty()) {
+        int32_t left = m_context.left(m_sequence, i);
+        int32_t right = m_context.right(m_sequence, i);
+        char leftSymbol = left >= 0 ? m_sequence.at(left) : 0;
+        char rightSymbol = right >= 0 ? m_sequence.at(right) : 0;
+        for (const ContextRule &rule : contextRules) {
+            if ((rule.left == 0 || rule.left == leftSymbol) && (rule.right == 0 || rule.right == rightSymbol)) {
+                replacement = { rule.replacement.data(), rule.replacement.size() };
+                return true;
+            }
+        }
+    }
+    int count = m_rules.replacementCount(c);
+    if (count == 0) {
+        return false;
+    }
+    replacement = m_rules.replacement(c, getReplacementIndex(count - 1, generation, i));
+    return true;
+}
+
+/**
+ * Returns the length of the longest replacement of a symbol, context-sensitive rules included.
+ * @brief LSystem::maxReplacementLength
+ */
+size_t LSystem::maxReplacementLength(char symbol) const {
+    return std::max(m_rules.maxReplacementLength(symbol), m_contextMaxLength[static_cast<unsigned char>(symbol)]);
+}
+
+/**
+ * Returns every symbol that can occur in the sequence: those of the axiom and of all replacements.
+ * @brief LSystem::alphabet
+ */
+std::vector<char> LSystem::alphabet() const {
+    bool seen[256] = {};
+    std::vector<char> symbols;
+    auto add = [&](char c) {
+        if (!seen[static_cast<unsigned char>(c)]) {
+            seen[static_cast<unsigned char>(c)] = true;
+            symbols.push_back(c);
         }
+    };
+    for (char c : m_axiom) {
+        add(c);
     }
+    for (char c : m_rules.symbols()) {
+        add(c);
+        for (int r = 0; r < m_rules.replacementCount(c); r++) {
+            RuleSpan replacement = m_rules.replacement(c, r);
+            std::for_each(replacement.data, replacement.data + replacement.length, add);
+        }
+    }
+    for (int u = 0; u < 256; u++) {
+        for (const ContextRule &rule : m_contextRules[u]) {
+            std::for_each(rule.replacement.begin(), rule.replacement.end(), add);
+        }
+    }
+    return symbols;
 }
 
 /**
- * Returns a uniformly distributed random number between 0 and the highest given index.
- * @brief LSystem::getRuleIndex
+ * Returns a uniformly distributed random number between 0 and the highest given index. The number
+ * only depends on the seed, the generation and the position of the symbol, so a sequence can be
+ * regenerated exactly.
+ * @brief LSystem::getReplacementIndex
  * @param maxIndex last index in the vector for rule replacements
+ * @param generation 0-based index of the pass being expanded
+ * @param symbolIndex position of the symbol being replaced in the current sequence
  * @return index
  */
-int LSystem::getReplacementIndex(int maxIndex){
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<int> distrib(0, maxIndex);
-    return distrib(gen);
+int LSystem::getReplacementIndex(int maxIndex, int generation, size_t symbolIndex) const {
+    if (maxIndex == 0) {
+        return 0;
+    }
+    return m_random.uniformInt(maxIndex, generation, symbolIndex);
 }
 
 std::string LSystem::getSequence(){
-    return m_sequence;
+    return m_sequence.toString();
+}
+
+/**
+ * Returns a generator that yields the expanded sequence one symbol at a time without
+ * materializing it. It produces the same symbols as generateSequence() followed by getSequence().
+ * Context-sensitive rules depend on the neighbours of a symbol in the whole previous generation,
+ * so with those the sequence is generated first and the stream reads it back.
+ * @brief LSystem::stream
+ */
+SymbolStream LSystem::stream() {
+    if (m_hasContextRules) {
+        generateSequence();
+        return SymbolStream(m_rules, m_random, m_sequence, 0);
+    }
+    return SymbolStream(m_rules, m_random, PackedSequence(alphabet(), m_axiom), m_recursions);
+}
+
+/**
+ * Builds the shared representation of the expanded sequence, in which every (symbol, passes left)
+ * expansion is stored once. Only possible for deterministic rules.
+ * @brief LSystem::buildDag
+ * @param dag DAG to fill in
+ * @return false if a rule is stochastic or context-sensitive, in which case the flat sequence must be used
+ */
+bool LSystem::buildDag(SequenceDag &dag) const {
+    if (m_hasContextRules) {
+        dag.clear();
+        return false;
+    }
+    return dag.build(m_rules, m_axiom, m_recursions);
 }
 
 void LSystem::setAxiom(std::string axiom){
-    m_sequence = axiom;
+    m_axiom = axiom;
+    m_sequence.setAlphabet(alphabet());
+    m_sequence.assign(axiom);
 }
 
-std::map<std::string, std::vector<std::string>> LSystem::getRules(){
+/**
+ * Returns the timing and output size of each pass of the last generateSequence() call.
+ * @brief LSystem::getGenerationStats
+ */
+const std::vector<GenerationStats> &LSystem::getGenerationStats() const {
+    return m_stats;
+}
+
+/**
+ * Returns a view of the compiled rules.
+ * @brief LSystem::getRules
+ */
+const RuleTable &LSystem::getRules() const {
     return m_rules;
 }
 
 /**
- * Adds rule to map of rules.
+ * Adds a rule for the first character of the key. Any symbol can carry rules, and adding several
+ * rules for the same symbol makes it stochastic.
+ *
+ * Keys of the form "A<B>C", "A<B" or "B>C" add a context-sensitive rule for B that only applies
+ * when the left context is A and the right context is C (see ContextIndex). Context-sensitive rules
+ * are tried in the order they were added, before the context-free rules of the symbol.
  * @brief LSystem::addRule
- * @param key key in the map
- * @param replacement value to add to vector in map
+ * @param key symbol to rewrite, optionally with its context
+ * @param replacement value to add to the replacements of the symbol
  */
 void LSystem::addRule(std::string key, std::string replacement){
-    if (key == "F"){
-       std::map<std::string, std::vector<std::string>>::iterator it = m_rules.find("F");
-       if (it != m_rules.end()){
-           it->second.push_back(replacement);
-       } else {
-           m_rules.insert(std::pair<std::string, std::vector<std::string>>(key,{replacement}));
-       }
-    } else if (key == "X"){
-        std::map<std::string, std::vector<std::string>>::iterator it = m_rules.find("X");
-        if (it != m_rules.end()){
-            it->second.push_back(replacement);
-        } else {
-            m_rules.insert(std::pair<std::string, std::vector<std::string>>(key,{replacement}));
-        }
+    key.erase(std::remove(key.begin(), key.end(), ' '), key.end());
+    if (key.empty()) {
+        return;
     }
+    size_t lt = key.find('<');
+    size_t gt = key.find('>');
+    if (lt == std::string::npos && gt == std::string::npos) {
+        m_rules.add(key[0], replacement);
+        return;
+    }
+
+    size_t symbolPos = lt == std::string::npos ? 0 : lt + 1;
+    bool valid = symbolPos < key.size() && (lt == std::string::npos || lt == 1) &&
+            (gt == std::string::npos ? key.size() == symbolPos + 1 : gt == symbolPos + 1 && key.size() == gt + 2);
+    if (!valid) {
+        std::cout << "BAD LSYSTEM RULE: " << key << std::endl;
+        return;
+    }
+    char symbol = key[symbolPos];
+    char left = lt == std::string::npos ? 0 : key[0];
+    char right = gt == std::string::npos ? 0 : key[gt + 1];
+    unsigned char u = static_cast<unsigned char>(symbol);
+    m_contextRules[u].push_back({ left, right, replacement });
+    m_contextMaxLength[u] = std::max(m_contextMaxLength[u], replacement.size());
+    m_hasContextRules = true;
+}
+
+/**
+ * Sets the symbols that context-sensitive rules skip over when looking for context, such as the
+ * turtle turns.
+ * @brief LSystem::setContextIgnore
+ * @param symbols every character is ignored
+ */
+void LSystem::setContextIgnore(std::string symbols){
+    m_context.setIgnored(symbols);
+}
+
+/**
+ * Returns whether any context-sensitive rules were added.
+ * @brief LSystem::hasContextRules
+ */
+bool LSystem::hasContextRules() const {
+    return m_hasContextRules;
 }
 
 /**
@@ -101,9 +367,148 @@ void LSystem::setRecursion(int recursions){
 }
 
 /**
- * Clears the map of rules.
+ * Sets the number of threads used to expand long generations. Values below 1 use one thread per
+ * hardware core. Only generateSequence() expands in parallel. stream() and buildDag() expand on
+ * the calling thread, except that stream() generates the sequence first for context-sensitive
+ * rules, so a Tree, which compiles from stream(), leaves this at one thread.
+ * @brief LSystem::setThreadCount
+ * @param threads number of threads
+ */
+void LSystem::setThreadCount(int threads){
+    if (threads < 1) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_threads = threads;
+}
+
+/**
+ * Predicts the length and symbol counts of the sequence after the given number of passes without
+ * expanding it. Row a of the production matrix holds how many of each symbol one a rewrites to,
+ * averaged over its alternatives for stochastic rules, so the counts after d passes are the axiom
+ * counts times the d-th power of the matrix. The power is taken by repeated squaring.
+ * Context-sensitive rules are left out, so with those the prediction is only the context-free
+ * estimate and is not exact.
+ * @brief LSystem::predictGrowth
+ * @param depth number of passes
+ */
+GrowthPrediction LSystem::predictGrowth(int depth) const {
+    GrowthPrediction prediction;
+    prediction.exact = !m_hasContextRules;
+
+    int index[256];
+    std::fill(index, index + 256, -1);
+    auto addSymbol = [&](char c) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (index[u] < 0) {
+            index[u] = prediction.symbols.size();
+            prediction.symbols.push_back(c);
+        }
+    };
+    for (char c : m_axiom) {
+        addSymbol(c);
+    }
+    for (char c : m_rules.symbols()) {
+        addSymbol(c);
+        for (int r = 0; r < m_rules.replacementCount(c); r++) {
+            RuleSpan replacement = m_rules.replacement(c, r);
+            for (size_t i = 0; i < replacement.length; i++) {
+                addSymbol(replacement.data[i]);
+            }
+        }
+    }
+
+    const size_t n = prediction.symbols.size();
+    typedef std::vector<double> Matrix; // row-major n x n
+    auto multiply = [n](const Matrix &A, const Matrix &B) {
+        Matrix C(n * n, 0.0);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t k = 0; k < n; k++) {
+                double a = A[i * n + k];
+                if (a == 0.0) continue;
+                for (size_t j = 0; j < n; j++) {
+                    C[i * n + j] += a * B[k * n + j];
+                }
+            }
+        }
+        return C;
+    };
+
+    Matrix production(n * n, 0.0);
+    for (size_t a = 0; a < n; a++) {
+        char c = prediction.symbols[a];
+        int count = m_rules.replacementCount(c);
+        if (count == 0) {
+            production[a * n + a] = 1.0;
+            continue;
+        }
+        if (count > 1) {
+            prediction.exact = false;
+        }
+        for (int r = 0; r < count; r++) {
+            RuleSpan replacement = m_rules.replacement(c, r);
+            for (size_t i = 0; i < replacement.length; i++) {
+                production[a * n + index[static_cast<unsigned char>(replacement.data[i])]] += 1.0 / count;
+            }
+        }
+    }
+
+    Matrix power(n * n, 0.0);
+    for (size_t i = 0; i < n; i++) {
+        power[i * n + i] = 1.0;
+    }
+    for (int e = std::max(0, depth); e > 0; e >>= 1) {
+        if (e & 1) {
+            power = multiply(power, production);
+        }
+        production = multiply(production, production);
+    }
+
+    prediction.counts.assign(n, 0.0);
+    for (char c : m_axiom) {
+        size_t a = index[static_cast<unsigned char>(c)];
+        for (size_t j = 0; j < n; j++) {
+            prediction.counts[j] += power[a * n + j];
+        }
+    }
+    prediction.length = 0.0;
+    for (double count : prediction.counts) {
+        prediction.length += count;
+    }
+    return prediction;
+}
+
+/**
+ * Returns the predicted number of the given symbol, 0 if it does not occur.
+ * @brief GrowthPrediction::count
+ */
+double GrowthPrediction::count(char symbol) const {
+    for (size_t i = 0; i < symbols.size(); i++) {
+        if (symbols[i] == symbol) {
+            return counts[i];
+        }
+    }
+    return 0.0;
+}
+
+/**
+ * Sets the seed used for stochastic rule choices.
+ * @brief LSystem::setSeed
+ * @param seed seed of the counter-based generator
+ */
+void LSystem::setSeed(uint32_t seed){
+    m_random.setSeed(seed);
+}
+
+/**
+ * Clears the rules.
  * @brief LSystem::clearRules
  */
 void LSystem::clearRules() {
     m_rules.clear();
+    for (int i = 0; i < 256; i++) {
+        m_contextRules[i].clear();
+    }
+    std::fill(m_contextMaxLength, m_contextMaxLength + 256, 0);
+    m_hasContextRules = false;
+    m_context.setIgnored("");
 }
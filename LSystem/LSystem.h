@@ -1,9 +1,35 @@
 #ifndef LSYSTEM_H
 #define LSYSTEM_H
 #include <string>
-#include <map>
 #include <vector>
+#include "lib/CounterRandom.h"
+#include "RuleTable.h"
+#include "SymbolStream.h"
+#include "SequenceDag.h"
+#include "ContextIndex.h"
+#include "PackedSequence.h"
 
+/**
+ * Timing and size of a single rewriting pass.
+ */
+struct GenerationStats {
+    int generation;      // 1-based index of the pass
+    size_t length;       // number of symbols after the pass
+    size_t bytes;        // storage used by the sequence after the pass
+    double milliseconds; // wall time spent in the pass
+};
+
+/**
+ * Size of an expanded sequence predicted from the rules alone.
+ */
+struct GrowthPrediction {
+    bool exact;                 // false if stochastic rules made the counts expected values
+    double length;              // total number of symbols
+    std::vector<char> symbols;  // alphabet of the axiom and the rules
+    std::vector<double> counts; // number of each symbol, in the order of symbols
+
+    double count(char symbol) const;
+};
 
 class LSystem
 {
@@ -11,18 +37,51 @@ public:
     LSystem();
     void generateSequence();
     std::string getSequence();
+    SymbolStream stream();
+    bool buildDag(SequenceDag &dag) const;
     void setRecursion(int recursion);
+    void setSeed(uint32_t seed);
+    void setThreadCount(int threads);
 
     void addRule(std::string key, std::string replacement);
-    std::map<std::string, std::vector<std::string>> getRules();
+    void setContextIgnore(std::string symbols);
+    bool hasContextRules() const;
+    const RuleTable &getRules() const;
     void clearRules();
     void setAxiom(std::string axiom);
+
+    const std::vector<GenerationStats> &getGenerationStats() const;
+    GrowthPrediction predictGrowth(int depth) const;
 private:
-    void expand();
-    int getReplacementIndex(int totalRules);
+    struct ContextRule {
+        char left;   // 0 if any left context is accepted
+        char right;  // 0 if any right context is accepted
+        std::string replacement;
+    };
+
+    static const size_t PARALLEL_MIN_LENGTH;
+    static const int CHUNKS_PER_THREAD;
+
+    void expand(int generation);
+    void expandParallel(int generation);
+    size_t measureRange(int generation, size_t begin, size_t end) const;
+    size_t writeRange(int generation, size_t begin, size_t end, PackedSequence &out, size_t position, char *deferred) const;
+    bool findReplacement(int generation, size_t i, char c, RuleSpan &replacement) const;
+    size_t maxReplacementLength(char symbol) const;
+    std::vector<char> alphabet() const;
+    int getReplacementIndex(int maxIndex, int generation, size_t symbolIndex) const;
     int m_recursions;
-    std::map<std::string, std::vector<std::string>> m_rules;
-    std::string m_sequence;
+    int m_threads;
+    CounterRandom m_random;
+    RuleTable m_rules;
+    std::vector<ContextRule> m_contextRules[256]; // by predecessor symbol, in the order they were added
+    size_t m_contextMaxLength[256];
+    bool m_hasContextRules;
+    ContextIndex m_context;
+    std::string m_axiom;
+    PackedSequence m_sequence;
+    PackedSequence m_nextSequence; // back buffer that each pass writes into before the swap
+    std::vector<GenerationStats> m_stats;
 };
 
 #endif // LSYSTEM_H
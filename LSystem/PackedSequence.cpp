@@ -0,0 +1,105 @@
+#include "PackedSequence.h"
+#include <algorithm>
+
+PackedSequence::PackedSequence():
+    m_packed(false),
+    m_length(0)
+{
+    std::fill(m_alphabet, m_alphabet + MAX_PACKED_SYMBOLS, 0);
+    std::fill(m_codes, m_codes + 256, 0);
+}
+
+PackedSequence::PackedSequence(const std::vector<char> &alphabet, const std::string &symbols):
+    PackedSequence()
+{
+    setAlphabet(alphabet);
+    assign(symbols);
+}
+
+PackedSequence::Writer::Writer(PackedSequence &sequence, size_t position, char *deferred):
+    m_data(sequence.m_data.data()),
+    m_codes(sequence.m_codes),
+    m_packed(sequence.m_packed),
+    m_start(position),
+    m_position(position),
+    m_deferred(sequence.m_packed && (position & 1) ? deferred : nullptr),
+    m_byte(0)
+{
+    if (m_packed && (position & 1) && !m_deferred) {
+        m_byte = m_data[position >> 1] & 0xF;
+    }
+}
+
+size_t PackedSequence::Writer::finish() {
+    if (m_packed && (m_position & 1) && m_position != m_start) {
+        m_data[m_position >> 1] = m_byte;
+    }
+    return m_position;
+}
+
+/**
+ * Sets the symbols the sequence can hold and clears it. Alphabets of up to 16 symbols are packed.
+ * @brief PackedSequence::setAlphabet
+ * @param alphabet every symbol that will be stored, without duplicates
+ */
+void PackedSequence::setAlphabet(const std::vector<char> &alphabet) {
+    clear();
+    m_packed = alphabet.size() <= MAX_PACKED_SYMBOLS;
+    std::fill(m_alphabet, m_alphabet + MAX_PACKED_SYMBOLS, 0);
+    std::fill(m_codes, m_codes + 256, 0);
+    if (m_packed) {
+        for (size_t i = 0; i < alphabet.size(); i++) {
+            m_alphabet[i] = alphabet[i];
+            m_codes[static_cast<unsigned char>(alphabet[i])] = i;
+        }
+    }
+}
+
+/**
+ * Replaces the contents with the given symbols, which must all be in the alphabet.
+ * @brief PackedSequence::assign
+ */
+void PackedSequence::assign(const std::string &symbols) {
+    resize(symbols.size());
+    for (size_t i = 0; i < symbols.size(); i++) {
+        set(i, symbols[i]);
+    }
+}
+
+/**
+ * Changes the number of symbols. Symbols below the new length keep their values.
+ * @brief PackedSequence::resize
+ */
+void PackedSequence::resize(size_t length) {
+    m_length = length;
+    m_data.resize(m_packed ? (length + 1) / 2 : length);
+}
+
+/**
+ * Removes all symbols, keeping the alphabet.
+ * @brief PackedSequence::clear
+ */
+void PackedSequence::clear() {
+    m_length = 0;
+    m_data.clear();
+}
+
+void PackedSequence::swap(PackedSequence &other) {
+    std::swap(m_packed, other.m_packed);
+    std::swap(m_length, other.m_length);
+    m_data.swap(other.m_data);
+    std::swap_ranges(m_alphabet, m_alphabet + MAX_PACKED_SYMBOLS, other.m_alphabet);
+    std::swap_ranges(m_codes, m_codes + 256, other.m_codes);
+}
+
+/**
+ * Unpacks the sequence to one byte per symbol.
+ * @brief PackedSequence::toString
+ */
+std::string PackedSequence::toString() const {
+    std::string symbols(m_length, 0);
+    for (size_t i = 0; i < m_length; i++) {
+        symbols[i] = at(i);
+    }
+    return symbols;
+}
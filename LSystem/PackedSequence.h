@@ -0,0 +1,123 @@
+#ifndef PACKEDSEQUENCE_H
+#define PACKEDSEQUENCE_H
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+
+/**
+ * Sequence of L-system symbols stored at 4 bits per symbol.
+ *
+ * The alphabet is set up front and every symbol is stored as its index in it, two per byte with
+ * the even position in the low nibble. Alphabets of more than 16 symbols do not fit, and the
+ * sequence then falls back to one byte per symbol. Two neighbouring symbols share a byte, so
+ * threads writing disjoint ranges must not write the first symbol of a range that starts at an odd
+ * position concurrently with the range before it.
+ */
+class PackedSequence
+{
+public:
+    static const size_t MAX_PACKED_SYMBOLS = 16;
+
+    class const_iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef char value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const char *pointer;
+        typedef char reference;
+
+        const_iterator(const PackedSequence *sequence, size_t index) : m_sequence(sequence), m_index(index) {}
+        char operator*() const { return m_sequence->at(m_index); }
+        const_iterator &operator++() { m_index++; return *this; }
+        bool operator==(const const_iterator &other) const { return m_index == other.m_index; }
+        bool operator!=(const const_iterator &other) const { return m_index != other.m_index; }
+        size_t index() const { return m_index; }
+    private:
+        const PackedSequence *m_sequence;
+        size_t m_index;
+    };
+
+    /**
+     * Appends symbols from a start position on, assembling each byte before storing it. A writer
+     * that starts at an odd position can hand its first symbol to deferred instead of writing it,
+     * so that concurrent writers never store to the same byte; the caller sets it afterwards.
+     */
+    class Writer {
+    public:
+        Writer(PackedSequence &sequence, size_t position, char *deferred = nullptr);
+        void put(char symbol) {
+            if (!m_packed) {
+                m_data[m_position++] = static_cast<uint8_t>(symbol);
+                return;
+            }
+            uint8_t code = m_codes[static_cast<unsigned char>(symbol)];
+            if (m_position & 1) {
+                if (m_deferred) {
+                    *m_deferred = symbol;
+                    m_deferred = nullptr;
+                } else {
+                    m_data[m_position >> 1] = m_byte | (code << 4);
+                }
+            } else {
+                m_byte = code;
+            }
+            m_position++;
+        }
+        // Stores a trailing half byte and returns the position after the last symbol.
+        size_t finish();
+    private:
+        // Copied out of the sequence so that byte stores cannot force them to be reloaded.
+        uint8_t *m_data;
+        const uint8_t *m_codes;
+        bool m_packed;
+        size_t m_start;
+        size_t m_position;
+        char *m_deferred;
+        uint8_t m_byte; // low nibble of the byte being assembled
+    };
+
+    PackedSequence();
+    PackedSequence(const std::vector<char> &alphabet, const std::string &symbols);
+
+    void setAlphabet(const std::vector<char> &alphabet);
+    void assign(const std::string &symbols);
+    void resize(size_t length);
+    void clear();
+    void swap(PackedSequence &other);
+
+    size_t size() const { return m_length; }
+    bool empty() const { return m_length == 0; }
+    bool isPacked() const { return m_packed; }
+    size_t bytes() const { return m_data.size(); }
+
+    char at(size_t i) const {
+        if (!m_packed) {
+            return static_cast<char>(m_data[i]);
+        }
+        return m_alphabet[(m_data[i >> 1] >> ((i & 1) << 2)) & 0xF];
+    }
+    void set(size_t i, char symbol) {
+        if (!m_packed) {
+            m_data[i] = static_cast<uint8_t>(symbol);
+            return;
+        }
+        uint8_t &byte = m_data[i >> 1];
+        int shift = (i & 1) << 2;
+        byte = static_cast<uint8_t>((byte & ~(0xF << shift)) | (m_codes[static_cast<unsigned char>(symbol)] << shift));
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_length); }
+    std::string toString() const;
+
+private:
+    bool m_packed;
+    size_t m_length;
+    std::vector<uint8_t> m_data;
+    char m_alphabet[MAX_PACKED_SYMBOLS];
+    uint8_t m_codes[256]; // index of every symbol in the alphabet
+};
+
+#endif // PACKEDSEQUENCE_H
@@ -0,0 +1,471 @@
+#include "ParametricLSystem.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+// Deepest operand stack an expression may need; checked when the expression is compiled.
+const int ParametricLSystem::MAX_STACK = 32;
+// Most parameters a single module may carry.
+const int ParametricLSystem::MAX_PARAMS = 16;
+
+ModuleString::ModuleString() {
+    clear();
+}
+
+void ModuleString::clear() {
+    symbols.clear();
+    params.clear();
+    offsets.assign(1, 0);
+}
+
+void ModuleString::append(char symbol, const float *values, int count) {
+    symbols.push_back(symbol);
+    params.insert(params.end(), values, values + count);
+    offsets.push_back(params.size());
+}
+
+/**
+ * Recursive descent compiler from expression text to ParametricLSystem bytecode.
+ */
+class ExpressionCompiler
+{
+public:
+    typedef ParametricLSystem::Opcode Opcode;
+
+    ExpressionCompiler(ParametricLSystem &lsystem, const std::string &text, size_t &pos, const std::vector<std::string> &formals):
+        m_lsystem(lsystem), m_text(text), m_pos(pos), m_formals(formals), m_depth(0), m_maxDepth(0), m_ok(true) {}
+
+    bool compile() {
+        parseOr();
+        return m_ok && m_maxDepth <= ParametricLSystem::MAX_STACK;
+    }
+
+private:
+    void emit(Opcode op, size_t arg = 0) {
+        // Instruction::arg is 16 bits wide
+        if (arg > std::numeric_limits<uint16_t>::max()) {
+            fail(op == ParametricLSystem::OP_CONST ? "too many constants" : "parameter index too large");
+            return;
+        }
+        m_lsystem.m_code.push_back({ op, static_cast<uint16_t>(arg) });
+        // Operands push one value, binary operators pop two and push one, negation leaves the depth alone.
+        if (op == ParametricLSystem::OP_CONST || op == ParametricLSystem::OP_PARAM) {
+            m_maxDepth = std::max(m_maxDepth, ++m_depth);
+        } else if (op != ParametricLSystem::OP_NEG) {
+            m_depth--;
+        }
+    }
+
+    void skipSpace() {
+        while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+            m_pos++;
+        }
+    }
+
+    bool accept(const char *token) {
+        skipSpace();
+        size_t length = std::char_traits<char>::length(token);
+        if (m_text.compare(m_pos, length, token) == 0) {
+            m_pos += length;
+            return true;
+        }
+        return false;
+    }
+
+    void fail(const std::string &message) {
+        if (m_ok) {
+            std::cout << "BAD LSYSTEM EXPRESSION: " << message << " at " << m_pos << " in \"" << m_text << "\"" << std::endl;
+        }
+        m_ok = false;
+    }
+
+    void parseOr() {
+        parseAnd();
+        while (m_ok && accept("||")) {
+            parseAnd();
+            emit(ParametricLSystem::OP_OR);
+        }
+    }
+
+    void parseAnd() {
+        parseComparison();
+        while (m_ok && accept("&&")) {
+            parseComparison();
+            emit(ParametricLSystem::OP_AND);
+        }
+    }
+
+    void parseComparison() {
+        parseSum();
+        // Two-character operators are tried first so "<=" is not read as "<".
+        static const struct { const char *token; Opcode op; } comparisons[] = {
+            { "<=", ParametricLSystem::OP_LE }, { ">=", ParametricLSystem::OP_GE },
+            { "==", ParametricLSystem::OP_EQ }, { "!=", ParametricLSystem::OP_NE },
+            { "<", ParametricLSystem::OP_LT }, { ">", ParametricLSystem::OP_GT },
+        };
+        for (const auto &comparison : comparisons) {
+            if (m_ok && accept(comparison.token)) {
+                parseSum();
+                emit(comparison.op);
+                return;
+            }
+        }
+    }
+
+    void parseSum() {
+        parseProduct();
+        while (m_ok) {
+            if (accept("+")) {
+                parseProduct();
+                emit(ParametricLSystem::OP_ADD);
+            } else if (accept("-")) {
+                parseProduct();
+                emit(ParametricLSystem::OP_SUB);
+            } else {
+                break;
+            }
+        }
+    }
+
+    void parseProduct() {
+        parseUnary();
+        while (m_ok) {
+            if (accept("*")) {
+                parseUnary();
+                emit(ParametricLSystem::OP_MUL);
+            } else if (accept("/")) {
+                parseUnary();
+                emit(ParametricLSystem::OP_DIV);
+            } else {
+                break;
+            }
+        }
+    }
+
+    void parseUnary() {
+        if (accept("-")) {
+            parseUnary();
+            emit(ParametricLSystem::OP_NEG);
+            return;
+        }
+        parsePrimary();
+        if (m_ok && accept("^")) {
+            parseUnary();
+            emit(ParametricLSystem::OP_POW);
+        }
+    }
+
+    void parsePrimary() {
+        skipSpace();
+        if (m_pos >= m_text.size()) {
+            fail("unexpected end");
+            return;
+        }
+        char c = m_text[m_pos];
+        if (c == '(') {
+            m_pos++;
+            parseOr();
+            if (!accept(")")) {
+                fail("missing )");
+            }
+        } else if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            const char *start = m_text.c_str() + m_pos;
+            char *end = nullptr;
+            float value = std::strtof(start, &end);
+            m_pos += end - start;
+            m_lsystem.m_constants.push_back(value);
+            emit(ParametricLSystem::OP_CONST, m_lsystem.m_constants.size() - 1);
+        } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            size_t start = m_pos;
+            while (m_pos < m_text.size() && (std::isalnum(static_cast<unsigned char>(m_text[m_pos])) || m_text[m_pos] == '_')) {
+                m_pos++;
+            }
+            std::string name = m_text.substr(start, m_pos - start);
+            for (size_t i = 0; i < m_formals.size(); i++) {
+                if (m_formals[i] == name) {
+                    emit(ParametricLSystem::OP_PARAM, i);
+                    return;
+                }
+            }
+            fail("unknown parameter " + name);
+        } else {
+            fail(std::string("unexpected ") + c);
+        }
+    }
+
+    ParametricLSystem &m_lsystem;
+    const std::string &m_text;
+    size_t &m_pos;
+    const std::vector<std::string> &m_formals;
+    int m_depth;
+    int m_maxDepth;
+    bool m_ok;
+};
+
+ParametricLSystem::ParametricLSystem():
+    m_recursions(2)
+{
+
+}
+
+/**
+ * Sets the starting modules. Parameters must be constant expressions, e.g. "A(1,0.5)".
+ * @brief ParametricLSystem::setAxiom
+ * @return false if the axiom could not be parsed
+ */
+bool ParametricLSystem::setAxiom(const std::string &axiom) {
+    // The axiom is compiled like a successor, evaluated once, and its bytecode discarded.
+    size_t codeSize = m_code.size(), constantsSize = m_constants.size();
+    size_t argumentsSize = m_arguments.size(), modulesSize = m_modules.size();
+
+    uint32_t first, count;
+    bool ok = compileModules(axiom, {}, first, count);
+    m_axiom.clear();
+    if (ok) {
+        float values[MAX_PARAMS];
+        for (uint32_t m = first; m < first + count; m++) {
+            const SuccessorModule &module = m_modules[m];
+            for (uint32_t a = 0; a < module.argCount; a++) {
+                values[a] = evaluate(m_arguments[module.firstArg + a], nullptr);
+            }
+            m_axiom.append(module.symbol, values, module.argCount);
+        }
+    }
+
+    m_code.resize(codeSize);
+    m_constants.resize(constantsSize);
+    m_arguments.resize(argumentsSize);
+    m_modules.resize(modulesSize);
+    m_sequence = m_axiom;
+    return ok;
+}
+
+/**
+ * Compiles and adds a rule.
+ * @brief ParametricLSystem::addRule
+ * @param predecessor symbol with its formal parameters, e.g. "A(l,w)"
+ * @param condition expression over the formal parameters, empty for an unconditional rule
+ * @param successor modules with parameter expressions, e.g. "F(l,w)[+(30)A(l*0.7,w)]"
+ * @return false if any part could not be parsed; the rule is not added then
+ */
+bool ParametricLSystem::addRule(const std::string &predecessor, const std::string &condition, const std::string &successor) {
+    size_t pos = 0;
+    while (pos < predecessor.size() && std::isspace(static_cast<unsigned char>(predecessor[pos]))) {
+        pos++;
+    }
+    if (pos == predecessor.size()) {
+        std::cout << "BAD LSYSTEM RULE: empty predecessor" << std::endl;
+        return false;
+    }
+
+    Rule rule;
+    rule.symbol = predecessor[pos++];
+    std::vector<std::string> formals;
+    size_t open = predecessor.find('(', pos);
+    if (open != std::string::npos) {
+        size_t close = predecessor.find(')', open);
+        if (close == std::string::npos) {
+            std::cout << "BAD LSYSTEM RULE: missing ) in " << predecessor << std::endl;
+            return false;
+        }
+        std::string name;
+        for (size_t i = open + 1; i <= close; i++) {
+            char c = predecessor[i];
+            if (c == ',' || c == ')') {
+                if (!name.empty()) formals.push_back(name);
+                name.clear();
+            } else if (!std::isspace(static_cast<unsigned char>(c))) {
+                name += c;
+            }
+        }
+    }
+    if (static_cast<int>(formals.size()) > MAX_PARAMS) {
+        std::cout << "BAD LSYSTEM RULE: too many parameters in " << predecessor << std::endl;
+        return false;
+    }
+    rule.paramCount = formals.size();
+
+    size_t codeSize = m_code.size(), constantsSize = m_constants.size();
+    size_t argumentsSize = m_arguments.size(), modulesSize = m_modules.size();
+    bool ok = true;
+
+    rule.hasCondition = condition.find_first_not_of(" \t") != std::string::npos;
+    rule.condition = { 0, 0 };
+    if (rule.hasCondition) {
+        size_t conditionPos = 0;
+        ok = compileExpression(condition, conditionPos, formals, rule.condition) &&
+             condition.find_first_not_of(" \t", conditionPos) == std::string::npos;
+    }
+    ok = ok && compileModules(successor, formals, rule.firstModule, rule.moduleCount);
+
+    if (!ok) {
+        m_code.resize(codeSize);
+        m_constants.resize(constantsSize);
+        m_arguments.resize(argumentsSize);
+        m_modules.resize(modulesSize);
+        return false;
+    }
+    m_rulesBySymbol[static_cast<unsigned char>(rule.symbol)].push_back(m_rules.size());
+    m_rules.push_back(rule);
+    return true;
+}
+
+void ParametricLSystem::clearRules() {
+    m_code.clear();
+    m_constants.clear();
+    m_arguments.clear();
+    m_modules.clear();
+    m_rules.clear();
+    for (std::vector<uint32_t> &rules : m_rulesBySymbol) {
+        rules.clear();
+    }
+}
+
+void ParametricLSystem::setRecursion(int recursions) {
+    m_recursions = recursions;
+}
+
+/**
+ * Expands the axiom the set number of times.
+ * @brief ParametricLSystem::generateSequence
+ */
+void ParametricLSystem::generateSequence() {
+    m_sequence = m_axiom;
+    for (int i = 0; i < m_recursions; i++) {
+        expand();
+    }
+}
+
+const ModuleString &ParametricLSystem::getSequence() const {
+    return m_sequence;
+}
+
+/**
+ * Rewrites every module of the sequence into the back buffer and swaps the two.
+ * @brief ParametricLSystem::expand
+ */
+void ParametricLSystem::expand() {
+    m_nextSequence.clear();
+    m_nextSequence.symbols.reserve(m_sequence.size() * 2);
+    m_nextSequence.offsets.reserve(m_sequence.size() * 2 + 1);
+    m_nextSequence.params.reserve(m_sequence.params.size() * 2);
+
+    float values[MAX_PARAMS];
+    for (size_t i = 0; i < m_sequence.size(); i++) {
+        char symbol = m_sequence.symbols[i];
+        int paramCount = m_sequence.paramCount(i);
+        const float *params = m_sequence.paramsOf(i);
+
+        const Rule *match = nullptr;
+        for (uint32_t r : m_rulesBySymbol[static_cast<unsigned char>(symbol)]) {
+            const Rule &rule = m_rules[r];
+            if (rule.paramCount == paramCount && (!rule.hasCondition || evaluate(rule.condition, params) != 0.f)) {
+                match = &rule;
+                break;
+            }
+        }
+        if (!match) {
+            m_nextSequence.append(symbol, params, paramCount);
+            continue;
+        }
+
+        for (uint32_t m = match->firstModule; m < match->firstModule + match->moduleCount; m++) {
+            const SuccessorModule &module = m_modules[m];
+            for (uint32_t a = 0; a < module.argCount; a++) {
+                values[a] = evaluate(m_arguments[module.firstArg + a], params);
+            }
+            m_nextSequence.append(module.symbol, values, module.argCount);
+        }
+    }
+    std::swap(m_sequence, m_nextSequence);
+}
+
+/**
+ * Parses a list of modules, each a symbol optionally followed by parenthesized, comma separated
+ * expressions, and appends them to m_modules.
+ * @brief ParametricLSystem::compileModules
+ */
+bool ParametricLSystem::compileModules(const std::string &text, const std::vector<std::string> &formals, uint32_t &firstModule, uint32_t &moduleCount) {
+    firstModule = m_modules.size();
+    moduleCount = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        char symbol = text[pos++];
+        if (std::isspace(static_cast<unsigned char>(symbol))) {
+            continue;
+        }
+        if (symbol == '(' || symbol == ')' || symbol == ',') {
+            std::cout << "BAD LSYSTEM MODULE: unexpected " << symbol << " in \"" << text << "\"" << std::endl;
+            return false;
+        }
+
+        SuccessorModule module = { symbol, static_cast<uint32_t>(m_arguments.size()), 0 };
+        if (pos < text.size() && text[pos] == '(') {
+            pos++;
+            do {
+                Expression argument;
+                if (!compileExpression(text, pos, formals, argument)) {
+                    return false;
+                }
+                m_arguments.push_back(argument);
+                module.argCount++;
+                while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+                    pos++;
+                }
+            } while (pos < text.size() && text[pos++] == ',');
+            if (text[pos - 1] != ')' || static_cast<int>(module.argCount) > MAX_PARAMS) {
+                std::cout << "BAD LSYSTEM MODULE: bad parameter list in \"" << text << "\"" << std::endl;
+                return false;
+            }
+        }
+        m_modules.push_back(module);
+        moduleCount++;
+    }
+    return true;
+}
+
+/**
+ * Compiles the expression starting at pos and leaves pos after it.
+ * @brief ParametricLSystem::compileExpression
+ */
+bool ParametricLSystem::compileExpression(const std::string &text, size_t &pos, const std::vector<std::string> &formals, Expression &expression) {
+    expression.begin = m_code.size();
+    ExpressionCompiler compiler(*this, text, pos, formals);
+    bool ok = compiler.compile();
+    expression.end = m_code.size();
+    return ok;
+}
+
+/**
+ * Runs the bytecode of an expression with the given actual parameters.
+ * @brief ParametricLSystem::evaluate
+ */
+float ParametricLSystem::evaluate(const Expression &expression, const float *params) const {
+    float stack[MAX_STACK];
+    int top = -1;
+    for (uint32_t pc = expression.begin; pc < expression.end; pc++) {
+        const Instruction &instruction = m_code[pc];
+        switch (instruction.op) {
+        case OP_CONST: stack[++top] = m_constants[instruction.arg]; break;
+        case OP_PARAM: stack[++top] = params[instruction.arg]; break;
+        case OP_NEG: stack[top] = -stack[top]; break;
+        case OP_ADD: top--; stack[top] = stack[top] + stack[top + 1]; break;
+        case OP_SUB: top--; stack[top] = stack[top] - stack[top + 1]; break;
+        case OP_MUL: top--; stack[top] = stack[top] * stack[top + 1]; break;
+        case OP_DIV: top--; stack[top] = stack[top] / stack[top + 1]; break;
+        case OP_POW: top--; stack[top] = std::pow(stack[top], stack[top + 1]); break;
+        case OP_LT: top--; stack[top] = stack[top] < stack[top + 1]; break;
+        case OP_GT: top--; stack[top] = stack[top] > stack[top + 1]; break;
+        case OP_LE: top--; stack[top] = stack[top] <= stack[top + 1]; break;
+        case OP_GE: top--; stack[top] = stack[top] >= stack[top + 1]; break;
+        case OP_EQ: top--; stack[top] = stack[top] == stack[top + 1]; break;
+        case OP_NE: top--; stack[top] = stack[top] != stack[top + 1]; break;
+        case OP_AND: top--; stack[top] = stack[top] != 0.f && stack[top + 1] != 0.f; break;
+        case OP_OR: top--; stack[top] = stack[top] != 0.f || stack[top + 1] != 0.f; break;
+        }
+    }
+    return top >= 0 ? stack[top] : 0.f;
+}
@@ -0,0 +1,103 @@
+#ifndef PARAMETRICLSYSTEM_H
+#define PARAMETRICLSYSTEM_H
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Sequence of parametric modules. Module i is symbols[i] with the parameters
+ * params[offsets[i]] .. params[offsets[i + 1] - 1], so the symbols read like a plain L-system
+ * string and the numbers sit in one packed array next to them.
+ */
+struct ModuleString {
+    std::vector<char> symbols;
+    std::vector<uint32_t> offsets;
+    std::vector<float> params;
+
+    ModuleString();
+    void clear();
+    void append(char symbol, const float *values, int count);
+    size_t size() const { return symbols.size(); }
+    int paramCount(size_t i) const { return offsets[i + 1] - offsets[i]; }
+    const float *paramsOf(size_t i) const { return params.data() + offsets[i]; }
+};
+
+/**
+ * L-system over parametric modules such as F(l,w) and +(a).
+ *
+ * Rules have the form  A(l,w) : l > 0.1 -> F(l,w)[+(30)A(l*0.7,w*0.7)]  and are added as the
+ * predecessor, the (optional) condition and the successor. All text is parsed when the rule is
+ * added: conditions and parameter expressions are compiled to a small stack bytecode, and the
+ * successor to a list of modules whose arguments point at that bytecode. Expanding a module is
+ * then only bytecode evaluation, without any string handling.
+ *
+ * Expressions support numbers, the predecessor's parameter names, + - * / ^, unary minus,
+ * comparisons (< > <= >= == !=), && and || and parentheses. The first rule whose symbol and
+ * parameter count match and whose condition holds is applied; modules without a matching rule
+ * are copied unchanged.
+ */
+class ParametricLSystem
+{
+public:
+    ParametricLSystem();
+
+    bool setAxiom(const std::string &axiom);
+    bool addRule(const std::string &predecessor, const std::string &condition, const std::string &successor);
+    void clearRules();
+    void setRecursion(int recursions);
+
+    void generateSequence();
+    const ModuleString &getSequence() const;
+
+private:
+    enum Opcode : uint8_t {
+        OP_CONST, OP_PARAM,
+        OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW, OP_NEG,
+        OP_LT, OP_GT, OP_LE, OP_GE, OP_EQ, OP_NE, OP_AND, OP_OR
+    };
+    struct Instruction {
+        Opcode op;
+        uint16_t arg;   // constant or parameter index
+    };
+    struct Expression {
+        uint32_t begin; // range in m_code
+        uint32_t end;
+    };
+    struct SuccessorModule {
+        char symbol;
+        uint32_t firstArg; // range in m_arguments
+        uint32_t argCount;
+    };
+    struct Rule {
+        char symbol;
+        int paramCount;
+        bool hasCondition;
+        Expression condition;
+        uint32_t firstModule; // range in m_modules
+        uint32_t moduleCount;
+    };
+
+    static const int MAX_STACK;
+    static const int MAX_PARAMS;
+
+    friend class ExpressionCompiler;
+
+    bool compileModules(const std::string &text, const std::vector<std::string> &formals, uint32_t &firstModule, uint32_t &moduleCount);
+    bool compileExpression(const std::string &text, size_t &pos, const std::vector<std::string> &formals, Expression &expression);
+    float evaluate(const Expression &expression, const float *params) const;
+    void expand();
+
+    std::vector<Instruction> m_code;
+    std::vector<float> m_constants;
+    std::vector<Expression> m_arguments;
+    std::vector<SuccessorModule> m_modules;
+    std::vector<Rule> m_rules;
+    std::vector<uint32_t> m_rulesBySymbol[256];
+
+    ModuleString m_axiom;
+    int m_recursions;
+    ModuleString m_sequence;
+    ModuleString m_nextSequence;
+};
+
+#endif // PARAMETRICLSYSTEM_H
@@ -0,0 +1,58 @@
+#include "RuleTable.h"
+#include <algorithm>
+
+RuleTable::RuleTable()
+{
+    compile();
+}
+
+/**
+ * Adds a replacement for the given symbol and recompiles the table.
+ * @brief RuleTable::add
+ * @param symbol symbol being rewritten
+ * @param replacement one alternative replacement for the symbol
+ */
+void RuleTable::add(char symbol, const std::string &replacement) {
+    if (std::find(m_symbols.begin(), m_symbols.end(), symbol) == m_symbols.end()) {
+        m_symbols.push_back(symbol);
+    }
+    m_source.push_back({ symbol, replacement });
+    compile();
+}
+
+/**
+ * Removes all rules.
+ * @brief RuleTable::clear
+ */
+void RuleTable::clear() {
+    m_symbols.clear();
+    m_source.clear();
+    compile();
+}
+
+/**
+ * Lays out the replacements of every symbol contiguously in the arena and fills in the table.
+ * @brief RuleTable::compile
+ */
+void RuleTable::compile() {
+    for (int i = 0; i < 256; i++) {
+        m_entries[i] = { 0, 0, 1 };
+    }
+    m_spans.clear();
+    m_arena.clear();
+
+    for (char symbol : m_symbols) {
+        Entry &e = m_entries[static_cast<unsigned char>(symbol)];
+        e.first = m_spans.size();
+        e.maxLength = 0;
+        for (const auto &rule : m_source) {
+            if (rule.first != symbol) {
+                continue;
+            }
+            m_spans.push_back({ static_cast<uint32_t>(m_arena.size()), static_cast<uint32_t>(rule.second.size()) });
+            m_arena += rule.second;
+            e.count++;
+            e.maxLength = std::max<uint32_t>(e.maxLength, rule.second.size());
+        }
+    }
+}
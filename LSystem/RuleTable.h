@@ -0,0 +1,63 @@
+#ifndef RULETABLE_H
+#define RULETABLE_H
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Non-owning view of one replacement string stored in a RuleTable.
+ */
+struct RuleSpan {
+    const char *data;
+    size_t length;
+};
+
+/**
+ * L-system productions compiled into a flat table indexed by the symbol byte.
+ *
+ * All replacement strings live back to back in one arena, grouped by symbol, so looking up the
+ * replacements of a symbol is one array index and never allocates. The table is recompiled from
+ * the list of added rules whenever a rule is added; rules are only added when a preset is chosen.
+ */
+class RuleTable
+{
+public:
+    RuleTable();
+
+    void add(char symbol, const std::string &replacement);
+    void clear();
+
+    bool hasRules(char symbol) const { return entry(symbol).count != 0; }
+    int replacementCount(char symbol) const { return entry(symbol).count; }
+    size_t maxReplacementLength(char symbol) const { return entry(symbol).maxLength; }
+    RuleSpan replacement(char symbol, int index) const {
+        const Span &span = m_spans[entry(symbol).first + index];
+        return { m_arena.data() + span.offset, span.length };
+    }
+
+    // Symbols that carry at least one rule, in the order they were first added.
+    const std::vector<char> &symbols() const { return m_symbols; }
+    size_t size() const { return m_symbols.size(); }
+
+private:
+    struct Entry {
+        uint32_t first;     // index of the first span of this symbol
+        uint32_t count;     // number of alternative replacements
+        uint32_t maxLength; // length of the longest replacement, 1 for symbols without rules
+    };
+    struct Span {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    const Entry &entry(char symbol) const { return m_entries[static_cast<unsigned char>(symbol)]; }
+    void compile();
+
+    Entry m_entries[256];
+    std::vector<Span> m_spans;
+    std::string m_arena;
+    std::vector<char> m_symbols;
+    std::vector<std::pair<char, std::string>> m_source; // rules as added, used to recompile
+};
+
+#endif // RULETABLE_H
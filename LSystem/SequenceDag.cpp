@@ -0,0 +1,177 @@
+#include "SequenceDag.h"
+#include <algorithm>
+
+SequenceDag::SequenceDag():
+    m_rules(nullptr),
+    m_recursions(0),
+    m_root(0)
+{
+    clear();
+}
+
+/**
+ * Builds the shared representation of the axiom expanded the given number of times.
+ * @brief SequenceDag::build
+ * @return false, leaving the DAG empty, if any rule is stochastic
+ */
+bool SequenceDag::build(const RuleTable &rules, const std::string &axiom, int recursions) {
+    clear();
+    for (char c : rules.symbols()) {
+        if (rules.replacementCount(c) > 1) {
+            return false;
+        }
+    }
+
+    m_rules = &rules;
+    m_recursions = std::max(0, recursions);
+    m_memo.assign(256 * (m_recursions + 1), -1);
+
+    // Children are laid out contiguously, so the root's children are collected before being appended.
+    std::vector<uint32_t> rootChildren;
+    uint64_t length = 0;
+    for (char c : axiom) {
+        uint32_t child = nodeFor(c, m_recursions);
+        rootChildren.push_back(child);
+        length += m_nodes[child].length;
+    }
+    m_root = m_nodes.size();
+    m_nodes.push_back({ 0, static_cast<uint32_t>(m_children.size()), static_cast<uint32_t>(rootChildren.size()), length });
+    m_children.insert(m_children.end(), rootChildren.begin(), rootChildren.end());
+
+    m_memo.clear();
+    m_memo.shrink_to_fit();
+    m_rules = nullptr;
+    return true;
+}
+
+/**
+ * Resets the DAG to the empty sequence.
+ * @brief SequenceDag::clear
+ */
+void SequenceDag::clear() {
+    m_nodes.clear();
+    m_children.clear();
+    m_memo.clear();
+    m_nodes.push_back({ 0, 0, 0, 0 });
+    m_root = 0;
+}
+
+/**
+ * Returns the node for a symbol with the given number of passes left, creating it and its
+ * descendants the first time the pair is seen.
+ * @brief SequenceDag::nodeFor
+ */
+uint32_t SequenceDag::nodeFor(char symbol, int remaining) {
+    const size_t key = static_cast<unsigned char>(symbol) * (m_recursions + 1) + remaining;
+    if (m_memo[key] >= 0) {
+        return m_memo[key];
+    }
+
+    if (remaining == 0 || !m_rules->hasRules(symbol)) {
+        uint32_t id = m_nodes.size();
+        m_nodes.push_back({ symbol, 0, 0, 1 });
+        m_memo[key] = id;
+        return id;
+    }
+
+    RuleSpan replacement = m_rules->replacement(symbol, 0);
+    std::vector<uint32_t> children;
+    children.reserve(replacement.length);
+    uint64_t length = 0;
+    for (size_t i = 0; i < replacement.length; i++) {
+        uint32_t child = nodeFor(replacement.data[i], remaining - 1);
+        children.push_back(child);
+        length += m_nodes[child].length;
+    }
+
+    uint32_t id = m_nodes.size();
+    m_nodes.push_back({ symbol, static_cast<uint32_t>(m_children.size()), static_cast<uint32_t>(children.size()), length });
+    m_children.insert(m_children.end(), children.begin(), children.end());
+    m_memo[key] = id;
+    return id;
+}
+
+uint64_t SequenceDag::length() const {
+    return m_nodes[m_root].length;
+}
+
+size_t SequenceDag::nodeCount() const {
+    return m_nodes.size();
+}
+
+/**
+ * Returns the symbol at the given position by descending through the node lengths, in
+ * O(recursions * replacement length).
+ * @brief SequenceDag::at
+ * @return 0 if the index is past the end of the sequence
+ */
+char SequenceDag::at(uint64_t index) const {
+    if (index >= length()) {
+        return 0;
+    }
+    uint32_t node = m_root;
+    while (m_nodes[node].childCount != 0) {
+        const Node &n = m_nodes[node];
+        for (uint32_t i = 0; i < n.childCount; i++) {
+            uint32_t child = m_children[n.firstChild + i];
+            if (index < m_nodes[child].length) {
+                node = child;
+                break;
+            }
+            index -= m_nodes[child].length;
+        }
+    }
+    return m_nodes[node].symbol;
+}
+
+/**
+ * Expands the DAG into a flat string.
+ * @brief SequenceDag::toString
+ */
+std::string SequenceDag::toString() const {
+    std::string sequence;
+    sequence.reserve(length());
+    Cursor walk = cursor();
+    char symbol;
+    while (walk.next(symbol)) {
+        sequence += symbol;
+    }
+    return sequence;
+}
+
+SequenceDag::Cursor SequenceDag::cursor() const {
+    return Cursor(*this);
+}
+
+SequenceDag::Cursor::Cursor(const SequenceDag &dag):
+    m_dag(dag)
+{
+    m_stack.push_back({ dag.m_root, 0 });
+}
+
+bool SequenceDag::Cursor::next(char &symbol) {
+    while (!m_stack.empty()) {
+        Frame &frame = m_stack.back();
+        const Node &node = m_dag.m_nodes[frame.node];
+        if (frame.child == node.childCount) {
+            m_stack.pop_back();
+            continue;
+        }
+        uint32_t child = m_dag.m_children[node.firstChild + frame.child++];
+        const Node &childNode = m_dag.m_nodes[child];
+        if (childNode.length == 0) {
+            continue; // erased by an empty replacement
+        }
+        if (childNode.childCount == 0) {
+            symbol = childNode.symbol;
+            return true;
+        }
+        m_stack.push_back({ child, 0 });
+    }
+    return false;
+}
+
+bool SequenceDag::Cursor::peek(char &symbol) {
+    Cursor copy = *this;
+    return copy.next(symbol);
+}
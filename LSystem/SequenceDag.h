@@ -0,0 +1,67 @@
+#ifndef SEQUENCEDAG_H
+#define SEQUENCEDAG_H
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "RuleTable.h"
+
+/**
+ * Shared (hash-consed) representation of a deterministic L-system expansion.
+ *
+ * The expansion of a symbol with d passes left is the same wherever that symbol occurs, so it is
+ * stored once as a node keyed on (symbol, d) whose children are the nodes of its replacement with
+ * d - 1 passes left. Memory is proportional to the number of distinct (symbol, d) pairs instead of
+ * to the length of the sequence. Stochastic rules give different expansions at different
+ * positions, so they cannot be shared; build() refuses them and the flat sequence has to be used.
+ */
+class SequenceDag
+{
+public:
+    SequenceDag();
+
+    bool build(const RuleTable &rules, const std::string &axiom, int recursions);
+    void clear();
+
+    uint64_t length() const;
+    char at(uint64_t index) const;
+    size_t nodeCount() const;
+    std::string toString() const;
+
+    /**
+     * Walks the sequence from the start, one symbol at a time.
+     */
+    class Cursor
+    {
+    public:
+        explicit Cursor(const SequenceDag &dag);
+        bool next(char &symbol);
+        bool peek(char &symbol);
+    private:
+        struct Frame {
+            uint32_t node;
+            uint32_t child;
+        };
+        const SequenceDag &m_dag;
+        std::vector<Frame> m_stack;
+    };
+    Cursor cursor() const;
+
+private:
+    struct Node {
+        char symbol;          // terminal symbol, only meaningful for a node of length 1 without children
+        uint32_t firstChild;  // index into m_children
+        uint32_t childCount;
+        uint64_t length;      // number of symbols the node expands to
+    };
+
+    uint32_t nodeFor(char symbol, int remaining);
+
+    const RuleTable *m_rules;
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_children;
+    std::vector<int32_t> m_memo;   // node of (symbol, remaining), indexed by symbol * (recursions + 1) + remaining
+    int m_recursions;
+    uint32_t m_root;
+};
+
+#endif // SEQUENCEDAG_H
@@ -0,0 +1,64 @@
+#include "SymbolStream.h"
+#include <algorithm>
+
+SymbolStream::SymbolStream(const RuleTable &rules, const CounterRandom &random, const PackedSequence &axiom, int recursions):
+    m_rules(rules),
+    m_random(random),
+    m_axiom(axiom),
+    m_recursions(std::max(0, recursions)),
+    m_counters(m_recursions + 1, 0),
+    m_hasPeeked(false),
+    m_peeked(0)
+{
+    m_stack.reserve(m_recursions + 1);
+    m_stack.push_back({ nullptr, m_axiom.size(), 0, 0 });
+}
+
+bool SymbolStream::next(char &symbol) {
+    if (m_hasPeeked) {
+        m_hasPeeked = false;
+        symbol = m_peeked;
+        return true;
+    }
+    return advance(symbol);
+}
+
+bool SymbolStream::peek(char &symbol) {
+    if (!m_hasPeeked) {
+        m_hasPeeked = advance(m_peeked);
+    }
+    symbol = m_peeked;
+    return m_hasPeeked;
+}
+
+/**
+ * Walks the expansion tree until the next symbol of the last generation is reached.
+ * @brief SymbolStream::advance
+ */
+bool SymbolStream::advance(char &symbol) {
+    while (!m_stack.empty()) {
+        Frame &frame = m_stack.back();
+        if (frame.position == frame.length) {
+            m_stack.pop_back();
+            continue;
+        }
+        char c = frame.data ? frame.data[frame.position] : m_axiom.at(frame.position);
+        frame.position++;
+        int depth = frame.depth;
+        uint64_t index = m_counters[depth]++;
+
+        int count = depth < m_recursions ? m_rules.replacementCount(c) : 0;
+        if (count == 0) {
+            // The symbol is copied unchanged into every later generation, where it still takes up a position.
+            for (int d = depth + 1; d <= m_recursions; d++) {
+                m_counters[d]++;
+            }
+            symbol = c;
+            return true;
+        }
+        int replacementIndex = count > 1 ? m_random.uniformInt(count - 1, depth, index) : 0;
+        RuleSpan replacement = m_rules.replacement(c, replacementIndex);
+        m_stack.push_back({ replacement.data, replacement.length, 0, depth + 1 });
+    }
+    return false;
+}
@@ -0,0 +1,51 @@
+#ifndef SYMBOLSTREAM_H
+#define SYMBOLSTREAM_H
+#include <string>
+#include <vector>
+#include "lib/CounterRandom.h"
+#include "RuleTable.h"
+#include "PackedSequence.h"
+
+/**
+ * Pull-based generator for the fully expanded sequence of an LSystem.
+ *
+ * Symbols are produced depth-first from an explicit stack of (replacement, position, depth)
+ * frames, so memory is O(recursions) instead of O(length of the sequence). The running count of
+ * symbols seen at each depth is the position that symbol would have in the materialized
+ * generation, so stochastic choices are keyed exactly as in LSystem::generateSequence() and both
+ * produce the same sequence.
+ *
+ * The stream reads the rule table of the LSystem that created it, so it must not be used after
+ * that LSystem's rules change.
+ */
+class SymbolStream
+{
+public:
+    SymbolStream(const RuleTable &rules, const CounterRandom &random, const PackedSequence &axiom, int recursions);
+
+    // Stores the next symbol in symbol, returns false once the sequence is exhausted.
+    bool next(char &symbol);
+    // Like next(), but the symbol is returned again by the following call to next().
+    bool peek(char &symbol);
+
+private:
+    struct Frame {
+        const char *data; // null for the axiom, which is read from m_axiom
+        size_t length;
+        size_t position;
+        int depth;       // generation the symbols of this frame belong to
+    };
+
+    bool advance(char &symbol);
+
+    const RuleTable &m_rules;
+    CounterRandom m_random;
+    PackedSequence m_axiom;
+    int m_recursions;
+    std::vector<Frame> m_stack;
+    std::vector<uint64_t> m_counters; // symbols produced so far at each depth
+    bool m_hasPeeked;
+    char m_peeked;
+};
+
+#endif // SYMBOLSTREAM_H
@@ -0,0 +1,115 @@
+#include "LSystemBenchmarks.h"
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <thread>
+
+/**
+ * Times generateSequence() with the axiom, rules and recursions of the L-system at every thread
+ * count from 1 to maxThreads.
+ * @brief LSystemBenchmarks::profileThreadScaling
+ * @param maxThreads highest thread count to measure, below 1 for one per hardware core
+ * @return one sample per thread count
+ */
+std::vector<ScalingSample> LSystemBenchmarks::profileThreadScaling(const LSystem &lsystem, int maxThreads) {
+    if (maxThreads < 1) {
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    LSystem copy = lsystem;
+
+    std::vector<ScalingSample> samples;
+    for (int threads = 1; threads <= maxThreads; threads++) {
+        copy.setThreadCount(threads);
+        auto start = std::chrono::steady_clock::now();
+        copy.generateSequence();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        double speedup = samples.empty() ? 1.0 : samples[0].milliseconds / elapsed.count();
+        samples.push_back({ threads, elapsed.count(), speedup });
+    }
+    return samples;
+}
+
+/**
+ * Finds the left and right context of every occurrence of a symbol in the sequence the L-system
+ * expands to, once with ContextIndex::scanLeft() and scanRight(), and once by building the index
+ * and reading left() and right(). This is the lookup a context-sensitive rule of that symbol makes.
+ * @brief LSystemBenchmarks::profileContextMatching
+ * @param ignored symbols skipped when looking for context
+ * @param symbol symbol whose context is looked up
+ */
+ContextBenchmark LSystemBenchmarks::profileContextMatching(const LSystem &lsystem, const std::string &ignored,
+                                                           char symbol) {
+    LSystem copy = lsystem;
+    copy.generateSequence();
+    std::string symbols = copy.getSequence();
+    std::set<char> alphabet(symbols.begin(), symbols.end());
+    PackedSequence sequence(std::vector<char>(alphabet.begin(), alphabet.end()), symbols);
+    ContextIndex index;
+    index.setIgnored(ignored);
+
+    ContextBenchmark benchmark;
+    benchmark.length = sequence.size();
+    benchmark.lookups = 0;
+    std::vector<int32_t> scanned;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sequence.size(); i++) {
+        if (sequence.at(i) == symbol) {
+            scanned.push_back(index.scanLeft(sequence, i));
+            scanned.push_back(index.scanRight(sequence, i));
+        }
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    benchmark.scanMilliseconds = elapsed.count();
+
+    std::vector<int32_t> indexed;
+    indexed.reserve(scanned.size());
+    start = std::chrono::steady_clock::now();
+    index.build(sequence);
+    for (size_t i = 0; i < sequence.size(); i++) {
+        if (sequence.at(i) == symbol) {
+            indexed.push_back(index.left(sequence, i));
+            indexed.push_back(index.right(sequence, i));
+        }
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    benchmark.indexedMilliseconds = elapsed.count();
+
+    benchmark.sequenceBytes = sequence.bytes();
+    benchmark.indexBytes = index.bytes();
+    benchmark.lookups = scanned.size() / 2;
+    benchmark.identical = scanned == indexed;
+    return benchmark;
+}
+
+/**
+ * Expands the L-system flat with generateSequence() and shared with buildDag(), and checks that
+ * the DAG reads back as the flat sequence through toString(), length() and at().
+ * @brief LSystemBenchmarks::profileDag
+ */
+DagBenchmark LSystemBenchmarks::profileDag(const LSystem &lsystem) {
+    LSystem copy = lsystem;
+    DagBenchmark benchmark = { false, 0, 0, 0, 0, false };
+
+    auto start = std::chrono::steady_clock::now();
+    copy.generateSequence();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    benchmark.flatMilliseconds = elapsed.count();
+    std::string flat = copy.getSequence();
+    benchmark.length = flat.size();
+
+    SequenceDag dag;
+    start = std::chrono::steady_clock::now();
+    benchmark.built = copy.buildDag(dag);
+    elapsed = std::chrono::steady_clock::now() - start;
+    benchmark.dagMilliseconds = elapsed.count();
+    if (!benchmark.built) {
+        return benchmark;
+    }
+    benchmark.nodes = dag.nodeCount();
+
+    benchmark.identical = dag.toString() == flat && dag.length() == flat.size() && dag.at(flat.size()) == 0;
+    for (size_t i = 0; i < flat.size() && benchmark.identical; i++) {
+        benchmark.identical = dag.at(i) == flat[i];
+    }
+    return benchmark;
+}
@@ -0,0 +1,53 @@
+#ifndef LSYSTEMBENCHMARKS_H
+#define LSYSTEMBENCHMARKS_H
+#include <string>
+#include <vector>
+#include "LSystem/LSystem.h"
+
+/**
+ * Time of a full generateSequence() call at a given thread count.
+ */
+struct ScalingSample {
+    int threads;
+    double milliseconds;
+    double speedup;      // relative to the single-threaded run
+};
+
+/**
+ * Time of finding the context of the same symbols by scanning and with a ContextIndex.
+ */
+struct ContextBenchmark {
+    size_t length;             // number of symbols in the sequence
+    size_t lookups;            // number of symbols whose context was found
+    double scanMilliseconds;
+    double indexedMilliseconds; // building the index and reading it
+    size_t sequenceBytes;      // the packed sequence
+    size_t indexBytes;         // the index built on it
+    bool identical;            // both found the same context
+};
+
+/**
+ * Time of expanding the same deterministic L-system flat and as a SequenceDag.
+ */
+struct DagBenchmark {
+    bool built;                // false if the rules are stochastic or context-sensitive
+    size_t length;             // number of symbols in the sequence
+    size_t nodes;              // nodes in the DAG
+    double flatMilliseconds;   // generateSequence()
+    double dagMilliseconds;    // buildDag()
+    bool identical;            // the DAG reads back as the flat sequence, through toString(), length() and at()
+};
+
+/**
+ * Benchmarks of expanding an L-system. They work on copies, so the L-systems they are given are
+ * left as they were.
+ */
+class LSystemBenchmarks
+{
+public:
+    static std::vector<ScalingSample> profileThreadScaling(const LSystem &lsystem, int maxThreads);
+    static ContextBenchmark profileContextMatching(const LSystem &lsystem, const std::string &ignored, char symbol);
+    static DagBenchmark profileDag(const LSystem &lsystem);
+};
+
+#endif // LSYSTEMBENCHMARKS_H
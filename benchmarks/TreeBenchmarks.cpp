@@ -0,0 +1,348 @@
+#include "TreeBenchmarks.h"
+#include "glm/gtx/transform.hpp"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace {
+
+// Returns the largest difference between two lists of transforms, or infinity if their lengths differ.
+float maxDifference(const std::vector<glm::mat4> &a, const std::vector<glm::mat4> &b) {
+    if (a.size() != b.size()) {
+        return std::numeric_limits<float>::infinity();
+    }
+    float difference = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        for (int c = 0; c < 4; c++) {
+            glm::vec4 d = glm::abs(a[i][c] - b[i][c]);
+            difference = std::max(difference, std::max(std::max(d.x, d.y), std::max(d.z, d.w)));
+        }
+    }
+    return difference;
+}
+
+}
+
+/**
+ * Times the turtle on sequences that each exercise one opcode (F for FORWARD, +- for TURN,
+ * [] for PUSH and POP), then on the plain sequence of the tree option, once with the character
+ * loop the turtle was before sequences were compiled and once compiled the way a tree is built.
+ * Parametric tree options only get the per-opcode sequences. Compiling collapses a run of forward
+ * symbols into one move, so FORWARD compiles to a single move, and its difference is the rounding
+ * the character loop piles up over the run.
+ * @brief TreeBenchmarks::profileTurtle
+ * @param treeSettings tree option, seed, recursions, angle and leaf size
+ * @param length number of symbols in each per-opcode sequence
+ * @return one benchmark per sequence
+ */
+std::vector<TurtleBenchmark> TreeBenchmarks::profileTurtle(const Settings &treeSettings, int length) {
+    Tree tree;
+    tree.m_settings = treeSettings;
+    tree.m_leafScale = treeSettings.leafSize;
+    tree.addTreeOptionRule(treeSettings.treeOption);
+    tree.m_random.setSeed(treeSettings.seed);
+    bool isParametric = tree.m_isParametric;
+    tree.m_isParametric = false;
+
+    struct Workload {
+        std::string name;
+        std::string sequence;
+    };
+    std::vector<Workload> workloads;
+    const std::vector<std::pair<std::string, std::string>> PATTERNS = {
+        { "FORWARD", "F" }, { "TURN", "+-" }, { "PUSH/POP", "[]" },
+    };
+    for (const auto &pattern : PATTERNS) {
+        Workload workload = { pattern.first, "" };
+        while (workload.sequence.size() < static_cast<size_t>(length)) {
+            workload.sequence += pattern.second;
+        }
+        workloads.push_back(workload);
+    }
+    if (!isParametric) {
+        workloads.push_back({ "tree", "" });
+    }
+
+    std::vector<TurtleBenchmark> benchmarks;
+    glm::mat4 model = glm::mat4();
+    for (Workload &workload : workloads) {
+        // The per-opcode sequences are the axiom of an L-system that only knows F
+        LSystem &lsystem = tree.m_lsystem;
+        if (workload.name == "tree") {
+            tree.addTreeOptionRule(treeSettings.treeOption);
+            tree.m_settings.recursions = treeSettings.recursions;
+        } else {
+            lsystem.clearRules();
+            lsystem.addRule("F", "F");
+            lsystem.setAxiom(workload.sequence);
+            tree.m_settings.recursions = 0;
+        }
+        lsystem.setSeed(treeSettings.seed);
+        lsystem.setRecursion(tree.m_settings.recursions);
+        lsystem.generateSequence();
+        workload.sequence = lsystem.getSequence();
+        std::vector<char> forwardSymbols = lsystem.getRules().symbols();
+
+        TurtleBenchmark benchmark;
+        benchmark.workload = workload.name;
+        benchmark.symbols = workload.sequence.size();
+
+        // Untimed passes, so neither timed pass pays for growing the output vectors
+        interpretCharacters(tree, workload.sequence, forwardSymbols, model);
+        tree.compileSequence();
+        tree.run(tree.m_program);
+        tree.emitTree(model, STAGE_BRANCHES | STAGE_LEAVES);
+
+        clearOutput(tree);
+        auto start = std::chrono::steady_clock::now();
+        interpretCharacters(tree, workload.sequence, forwardSymbols, model);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        benchmark.characterMilliseconds = elapsed.count();
+        Branch branches = *tree.m_branchData;
+        std::vector<glm::mat4> leaves = *tree.m_leafData;
+
+        clearOutput(tree);
+        start = std::chrono::steady_clock::now();
+        tree.compileSequence();
+        elapsed = std::chrono::steady_clock::now() - start;
+        benchmark.compileMilliseconds = elapsed.count();
+        start = std::chrono::steady_clock::now();
+        tree.run(tree.m_program);
+        tree.emitTree(model, STAGE_BRANCHES | STAGE_LEAVES);
+        elapsed = std::chrono::steady_clock::now() - start;
+        benchmark.runMilliseconds = elapsed.count();
+
+        benchmark.maxDifference = std::max(maxDifference(branches.body, tree.m_branchData->body),
+                std::max(maxDifference(branches.tip, tree.m_branchData->tip), maxDifference(leaves, *tree.m_leafData)));
+        benchmarks.push_back(benchmark);
+    }
+    return benchmarks;
+}
+
+/**
+ * Times every emission kernel this CPU supports on the same random instances, on one thread.
+ * The instances use the bases of an untransformed tree with the leaf size of the settings.
+ * @brief TreeBenchmarks::profileEmission
+ * @param treeSettings seed and leaf size
+ * @param count number of instances
+ * @return one benchmark per kernel, the scalar reference first
+ */
+std::vector<EmissionBenchmark> TreeBenchmarks::profileEmission(const Settings &treeSettings, int count) {
+    Tree tree;
+    tree.m_leafScale = treeSettings.leafSize;
+    tree.m_random.setSeed(treeSettings.seed);
+    // Random stream for the instances, apart from the angle jitter
+    const uint32_t STREAM = Tree::ANGLE_STREAM + 1;
+    std::vector<glm::mat4> bases = tree.getInstanceBases(glm::mat4());
+    InstanceBatch batch;
+    batch.reserve(count);
+    for (int i = 0; i < count; i++) {
+        auto random = [&](int k) { return tree.m_random.uniformFloat(STREAM, uint64_t(i) * 11 + k); };
+        glm::vec3 position = glm::vec3(random(0), random(1), random(2)) * 20.f - 10.f;
+        glm::quat orientation = glm::quat(random(3) - .5f, random(4) - .5f, random(5) - .5f, random(6) - .5f);
+        glm::vec3 scale = glm::vec3(random(7), random(8), random(9)) + .01f;
+        batch.add(position, orientation, scale, static_cast<uint32_t>(random(10) * bases.size()));
+    }
+
+    std::vector<EmissionBenchmark> benchmarks;
+    std::vector<glm::mat4> reference(count);
+    std::vector<glm::mat4> out(count);
+    for (InstanceKernel kernel : { KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX }) {
+        if (!InstanceBatch::isSupported(kernel)) {
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        batch.emit(bases, 0, count, kernel == KERNEL_SCALAR ? reference.data() : out.data(), kernel);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        EmissionBenchmark benchmark;
+        benchmark.kernel = InstanceBatch::kernelName(kernel);
+        benchmark.instances = count;
+        benchmark.milliseconds = elapsed.count();
+        benchmark.instancesPerSecond = count / (elapsed.count() / 1000.0);
+        benchmark.maxDifference = kernel == KERNEL_SCALAR ? 0.f : maxDifference(reference, out);
+        benchmarks.push_back(benchmark);
+    }
+    return benchmarks;
+}
+
+/**
+ * Times the turtle over the tree option at every thread count from 1 to maxThreads. The sequence
+ * is expanded and compiled once beforehand, so only the turtle and emitting are timed.
+ * @brief TreeBenchmarks::profileThreadScaling
+ * @param treeSettings tree option, seed, recursions, angle and leaf size
+ * @param maxThreads highest thread count to measure, below 1 for one per hardware core
+ * @return one sample per thread count
+ */
+std::vector<ScalingSample> TreeBenchmarks::profileThreadScaling(const Settings &treeSettings, int maxThreads) {
+    Tree tree;
+    tree.setThreadCount(maxThreads);
+    maxThreads = tree.m_threads;
+
+    tree.m_settings = treeSettings;
+    tree.m_leafScale = treeSettings.leafSize;
+    tree.compileTree();
+    std::vector<ScalingSample> samples;
+    for (int threads = 1; threads <= maxThreads; threads++) {
+        tree.m_threads = threads;
+        clearOutput(tree);
+        auto start = std::chrono::steady_clock::now();
+        tree.run(tree.m_program);
+        tree.emitTree(glm::mat4(), STAGE_BRANCHES | STAGE_LEAVES);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        double speedup = samples.empty() ? 1.0 : samples[0].milliseconds / elapsed.count();
+        samples.push_back({ threads, elapsed.count(), speedup });
+    }
+    return samples;
+}
+
+/**
+ * Sets up the plain L-system of the tree option, for the L-system benchmarks.
+ * @brief TreeBenchmarks::setUpLSystem
+ * @param treeSettings tree option, seed and recursions
+ * @return false if the tree option is a parametric one
+ */
+bool TreeBenchmarks::setUpLSystem(LSystem &lsystem, const Settings &treeSettings) {
+    ParametricLSystem parametric;
+    if (Tree::setUpParametricLSystem(parametric, treeSettings.treeOption)) {
+        return false;
+    }
+    Tree::setUpLSystem(lsystem, treeSettings.treeOption);
+    lsystem.setSeed(treeSettings.seed);
+    lsystem.setRecursion(treeSettings.recursions);
+    return true;
+}
+
+/**
+ * The turtle as a character loop over a materialized plain sequence, as it was before sequences
+ * were compiled, adding to the branch and leaf data of the tree.
+ * @brief TreeBenchmarks::interpretCharacters
+ * @param sequence expanded sequence
+ * @param forwardSymbols symbols that move the turtle forward
+ * @param model the initial model matrix
+ */
+void TreeBenchmarks::interpretCharacters(Tree &tree, const std::string &sequence, const std::vector<char> &forwardSymbols,
+                                         const glm::mat4 &model) {
+    float ANGLE = glm::radians(tree.m_settings.angle);
+
+    LState currState = {
+        -Tree::TRANSLATE, //Needed to avoid overtranslating
+        0,
+        glm::quat(),
+        Tree::INIT_SCALE_FACTOR,
+        glm::quat(),
+        Tree::INIT_SCALE_FACTOR,
+        TurtleOutput::NO_SEGMENT,
+    };
+    std::vector<LState> prevStates;
+    std::vector<LState> bodyStates;
+    Branch &branchData = *tree.m_branchData;
+
+    int branchNum = 0;
+
+    for (size_t i = 0 ; i < sequence.size() ; i++) {
+        switch (sequence[i]) {
+            case '-':
+            case '+': {
+                glm::vec3 axis = Tree::ROTATE_AXES[tree.getRotateAxisIndex(branchNum)];
+                float newAngle = ANGLE + glm::radians(tree.getAngleJitter(branchNum) * 1.f);
+                if (sequence[i] == '-') {
+                    newAngle = -newAngle;
+                }
+                currState.orientation = glm::angleAxis(newAngle, glm::normalize(axis)) * currState.orientation;
+                if (currState.length == 0) {
+                    currState.initialOrientation = currState.orientation;
+                }
+                break;
+            }
+            case '[': {
+                prevStates.push_back(currState);
+                currState.scale *= Tree::SCALE_FACTOR;
+                currState = tree.createNewBranchState(currState);
+                break;
+            }
+            case ']': {
+                branchData.tip.push_back(getBranchTransform(model, currState));
+                glm::vec3 leafAxis = Tree::ROTATE_AXES[tree.getRotateAxisIndex(std::max(branchNum - 1, 0))];
+                buildLeaves(tree, model, currState, leafAxis, *tree.m_leafData);
+                currState = prevStates.back();
+                prevStates.pop_back();
+                break;
+            }
+        default:
+            if (std::find(forwardSymbols.begin(), forwardSymbols.end(), sequence[i]) != forwardSymbols.end()) {
+                branchNum++;
+                bool isNewBranch = currState.length != 0 && !tree.hasInitialTransform(currState);
+
+                if (isNewBranch) {
+                    LState branchInitState = tree.getBranchInitialStateTransforms(currState);
+                    if (i < sequence.size() - 1 && sequence[i + 1] != ']') {
+                        bodyStates.push_back(branchInitState);
+                    } else {
+                        branchData.tip.push_back(getBranchTransform(model, branchInitState));
+                    }
+                    currState = tree.createNewBranchState(currState);
+                }
+
+                currState.position += currState.orientation * (currState.scale * Tree::TRANSLATE);
+                currState.length += Tree::BRANCH_LENGTH;
+            } else {
+                std::cout << "BAD LSYSTEM SYMBOL: " << sequence[i] << std::endl;
+            }
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < bodyStates.size(); i++) {
+        LState savedState = bodyStates[i];
+        branchData.body.push_back(getBranchTransform(model, savedState));
+
+        glm::mat4 newScale = glm::scale(glm::mat4(), glm::vec3(1.f, .2f, 1.f));
+        glm::mat4 newTrans = glm::translate(glm::mat4(), glm::vec3(0.f, Tree::BRANCH_LENGTH * .43f, 0.f));
+
+        savedState.length += Tree::BRANCH_LENGTH;
+        glm::mat4 t = getBranchTransform(model, savedState)  * newTrans * newScale;
+        branchData.tip.push_back(t);
+    }
+
+    if (currState.length != 0) {
+        branchData.tip.push_back(getBranchTransform(model, currState));
+    }
+}
+
+//Calculates the overall transformation matrix of a branch given its current state
+glm::mat4 TreeBenchmarks::getBranchTransform(const glm::mat4 &model, const LState &state) {
+    if (state.length == 0) {
+        return glm::mat4(0);
+    }
+    glm::vec3 selfScale = { 1.f, Tree::BRANCH_LENGTH * state.length, 1.f };
+    return glm::scale(Tree::getPlacement(state), state.scale * selfScale) * model;
+}
+
+/**
+ * Adds the leaf transforms at the end of a branch: one on top and, unless the tree is 2D, one on
+ * each side.
+ * @brief TreeBenchmarks::buildLeaves
+ * @param leafAxis axis the side leaves turn on
+ * @param leaves vector the leaf transforms are added to
+ */
+void TreeBenchmarks::buildLeaves(Tree &tree, const glm::mat4 &model, const LState &state, const glm::vec3 &leafAxis,
+                                 std::vector<glm::mat4> &leaves) {
+    for (LeafDir dir : { TOP, LEFT, RIGHT }) {
+        if (state.length == 0) {
+            leaves.push_back(glm::mat4(0));
+        } else {
+            leaves.push_back(Tree::getPlacement(state) * Tree::getLeafOffset(leafAxis, dir, tree.m_leafScale) * model);
+        }
+        if (tree.m_is2D) {
+            break;
+        }
+    }
+}
+
+// Empties the branch and leaf data, keeping their capacity
+void TreeBenchmarks::clearOutput(Tree &tree) {
+    tree.m_branchData->body.clear();
+    tree.m_branchData->tip.clear();
+    tree.m_leafData->clear();
+}
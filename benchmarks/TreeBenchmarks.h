@@ -0,0 +1,53 @@
+#ifndef TREEBENCHMARKS_H
+#define TREEBENCHMARKS_H
+#include <string>
+#include <vector>
+#include "tree/Tree.h"
+#include "LSystemBenchmarks.h"
+
+/**
+ * Time of running the turtle over the same symbols with the character loop and as a compiled
+ * program.
+ */
+struct TurtleBenchmark {
+    std::string workload;         // opcode the symbols exercise, or "tree" for the tree option
+    size_t symbols;
+    double characterMilliseconds;
+    double compileMilliseconds;
+    double runMilliseconds;       // running the compiled program and emitting, without compiling it
+    float maxDifference;          // largest difference between the transforms of both
+};
+
+/**
+ * Throughput of one instance emission kernel.
+ */
+struct EmissionBenchmark {
+    std::string kernel;
+    size_t instances;
+    double milliseconds;
+    double instancesPerSecond;
+    float maxDifference;          // largest difference from the transforms of the scalar kernel
+};
+
+/**
+ * Benchmarks of the stages of building a tree. Each one builds a Tree of its own, so nothing
+ * that is drawn is touched.
+ */
+class TreeBenchmarks
+{
+public:
+    static std::vector<TurtleBenchmark> profileTurtle(const Settings &treeSettings, int length);
+    static std::vector<EmissionBenchmark> profileEmission(const Settings &treeSettings, int count);
+    static std::vector<ScalingSample> profileThreadScaling(const Settings &treeSettings, int maxThreads);
+    static bool setUpLSystem(LSystem &lsystem, const Settings &treeSettings);
+
+private:
+    static void interpretCharacters(Tree &tree, const std::string &sequence, const std::vector<char> &forwardSymbols,
+                                    const glm::mat4 &model);
+    static glm::mat4 getBranchTransform(const glm::mat4 &model, const LState &state);
+    static void buildLeaves(Tree &tree, const glm::mat4 &model, const LState &state, const glm::vec3 &leafAxis,
+                            std::vector<glm::mat4> &leaves);
+    static void clearOutput(Tree &tree);
+};
+
+#endif // TREEBENCHMARKS_H
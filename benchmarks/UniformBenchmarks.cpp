@@ -0,0 +1,71 @@
+#include "UniformBenchmarks.h"
+#include "uniforms/uniformvariable.h"
+#include "glm/gtc/type_ptr.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+/**
+ * Sets a scratch mat4 uniform count times with different matrices, first the way GLWidget used
+ * to, by formatting the matrix with a stringstream and parsing the text, then with setMat4().
+ * @brief UniformBenchmarks::profileMatrixUpdates
+ * @param count number of updates
+ */
+UniformBenchmark UniformBenchmarks::profileMatrixUpdates(int count)
+{
+    std::vector<glm::mat4> matrices(count);
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < 16; k++) {
+            matrices[i][k / 4][k % 4] = ((i * 16 + k) % 997) * .0137f - 6.8f;
+        }
+    }
+    auto setAsText = [](UniformVariable &uniform, const glm::mat4 &matrix) {
+        std::stringstream s;
+        glm::mat4 transposed = glm::transpose(matrix);
+        const float *data = glm::value_ptr(transposed);
+        for (int i = 0; i < 16; i++) {
+            s << data[i];
+            if (i < 15)
+                s << ",";
+        }
+        uniform.parse(QString::fromStdString(s.str()));
+    };
+
+    UniformVariable uniform(0);
+    uniform.setName("profile");
+    uniform.setType(UniformVariable::TYPE_MAT4);
+    UniformBenchmark benchmark;
+    benchmark.updates = count;
+
+    auto start = std::chrono::steady_clock::now();
+    for (const glm::mat4 &matrix : matrices) {
+        setAsText(uniform, matrix);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    benchmark.textMilliseconds = elapsed.count();
+
+    start = std::chrono::steady_clock::now();
+    for (const glm::mat4 &matrix : matrices) {
+        uniform.setMat4(matrix);
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    benchmark.typedMilliseconds = elapsed.count();
+
+    benchmark.textUpdatesPerSecond = count / (benchmark.textMilliseconds / 1000.0);
+    benchmark.typedUpdatesPerSecond = count / (benchmark.typedMilliseconds / 1000.0);
+
+    benchmark.maxDifference = 0;
+    GLfloat typed[16];
+    for (const glm::mat4 &matrix : matrices) {
+        uniform.setMat4(matrix);
+        memcpy(typed, uniform.floatValue(), sizeof(typed));
+        setAsText(uniform, matrix);
+        for (int k = 0; k < 16; k++) {
+            benchmark.maxDifference = std::max(benchmark.maxDifference, std::abs(typed[k] - uniform.floatValue()[k]));
+        }
+    }
+    return benchmark;
+}
@@ -0,0 +1,27 @@
+#ifndef UNIFORMBENCHMARKS_H
+#define UNIFORMBENCHMARKS_H
+#include <cstddef>
+
+/**
+ * Rate of setting a mat4 uniform by formatting and parsing it as text and with setMat4().
+ */
+struct UniformBenchmark {
+    size_t updates;
+    double textMilliseconds;
+    double typedMilliseconds;
+    double textUpdatesPerSecond;
+    double typedUpdatesPerSecond;
+    float maxDifference;          // largest difference the text round trip makes to the values
+};
+
+/**
+ * Benchmarks of setting uniform values. Nothing is uploaded, so they need no context; Qt warns
+ * once that the scratch uniform's GL functions have none.
+ */
+class UniformBenchmarks
+{
+public:
+    static UniformBenchmark profileMatrixUpdates(int count);
+};
+
+#endif // UNIFORMBENCHMARKS_H
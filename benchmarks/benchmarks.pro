@@ -0,0 +1,25 @@
+# -------------------------------------------------
+# Benchmarks of building and drawing trees, kept out of the application.
+# Run from the build directory: benchmarks [tree option] [recursions] [seed]
+# -------------------------------------------------
+TARGET = benchmarks
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++14
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE += -O3
+
+include(../sources.pri)
+
+SOURCES += \
+    main.cpp \
+    LSystemBenchmarks.cpp \
+    TreeBenchmarks.cpp \
+    UniformBenchmarks.cpp
+
+HEADERS += \
+    LSystemBenchmarks.h \
+    TreeBenchmarks.h \
+    UniformBenchmarks.h
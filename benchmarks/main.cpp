@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "TreeBenchmarks.h"
+#include "UniformBenchmarks.h"
+
+/**
+ * Runs the benchmarks on one tree and prints what they measured.
+ * Usage: benchmarks [tree option] [recursions] [seed]
+ */
+int main(int argc, char *argv[])
+{
+    Settings treeSettings;
+    treeSettings.treeOption = argc > 1 ? atoi(argv[1]) : 4;
+    treeSettings.recursions = argc > 2 ? atoi(argv[2]) : 8;
+    treeSettings.seed = argc > 3 ? atoi(argv[3]) : 0;
+    treeSettings.angle = 25;
+    treeSettings.leafSize = 1;
+    treeSettings.season = 0;
+    treeSettings.ifBumpMap = false;
+    printf("Tree option %d, %d recursions, seed %d\n\n", treeSettings.treeOption, treeSettings.recursions,
+           treeSettings.seed);
+
+    printf("Turtle: character loop against compiled program\n");
+    for (const TurtleBenchmark &b : TreeBenchmarks::profileTurtle(treeSettings, 1000000)) {
+        printf("  %-10s %9zu symbols  characters %8.2f ms  compile %8.2f ms  run %8.2f ms  max difference %g\n",
+               b.workload.c_str(), b.symbols, b.characterMilliseconds, b.compileMilliseconds, b.runMilliseconds,
+               b.maxDifference);
+    }
+
+    printf("\nEmission: instances on one thread, against the scalar kernel\n");
+    for (const EmissionBenchmark &b : TreeBenchmarks::profileEmission(treeSettings, 1000000)) {
+        printf("  %-10s %9zu instances  %8.2f ms  %8.1f M/s  max difference %g\n", b.kernel.c_str(), b.instances,
+               b.milliseconds, b.instancesPerSecond / 1e6, b.maxDifference);
+    }
+
+    LSystem lsystem;
+    bool isPlain = TreeBenchmarks::setUpLSystem(lsystem, treeSettings);
+    if (isPlain) {
+        printf("\nL-system: generateSequence() against thread count\n");
+        for (const ScalingSample &s : LSystemBenchmarks::profileThreadScaling(lsystem, 4)) {
+            printf("  %d threads  %8.2f ms  x%.2f\n", s.threads, s.milliseconds, s.speedup);
+        }
+
+        // The context a rule on F with the turns ignored would see
+        ContextBenchmark context = LSystemBenchmarks::profileContextMatching(lsystem, "+-", 'F');
+        printf("\nL-system: context of F by scanning against the index\n");
+        printf("  %zu symbols, %zu lookups  scan %8.2f ms  index %8.2f ms  identical %s\n", context.length,
+               context.lookups, context.scanMilliseconds, context.indexedMilliseconds,
+               context.identical ? "yes" : "no");
+        printf("  sequence %zu bytes, index %zu bytes (%.2f per symbol)\n", context.sequenceBytes,
+               context.indexBytes, double(context.indexBytes) / context.length);
+    }
+
+    // An erasing rule, Y -> "", next to a deterministic tree, so the DAG has to skip erased symbols
+    LSystem erasing;
+    erasing.clearRules();
+    erasing.setAxiom("X");
+    erasing.addRule("X", "F[-X][+XY]Y");
+    erasing.addRule("Y", "");
+    erasing.addRule("F", "FF");
+    erasing.setRecursion(treeSettings.recursions);
+    printf("\nL-system: flat sequence against the DAG\n");
+    std::vector<std::pair<const char *, const LSystem *>> dagSystems = { { "erasing", &erasing } };
+    if (isPlain) {
+        dagSystems.insert(dagSystems.begin(), { "tree", &lsystem });
+    }
+    for (const auto &system : dagSystems) {
+        DagBenchmark dag = LSystemBenchmarks::profileDag(*system.second);
+        if (!dag.built) {
+            printf("  %-8s stochastic or context-sensitive, flat only\n", system.first);
+            continue;
+        }
+        printf("  %-8s %9zu symbols, %zu nodes  flat %8.2f ms  DAG %8.2f ms  identical %s\n", system.first,
+               dag.length, dag.nodes, dag.flatMilliseconds, dag.dagMilliseconds, dag.identical ? "yes" : "no");
+    }
+
+    printf("\nTree: turtle and emission against thread count\n");
+    for (const ScalingSample &s : TreeBenchmarks::profileThreadScaling(treeSettings, 4)) {
+        printf("  %d threads  %8.2f ms  x%.2f\n", s.threads, s.milliseconds, s.speedup);
+    }
+
+    UniformBenchmark uniforms = UniformBenchmarks::profileMatrixUpdates(100000);
+    printf("\nUniforms: mat4 as text against setMat4()\n");
+    printf("  %zu updates  text %8.2f ms (%.2f M/s)  setMat4 %8.2f ms (%.2f M/s)  max difference %g\n",
+           uniforms.updates, uniforms.textMilliseconds, uniforms.textUpdatesPerSecond / 1e6,
+           uniforms.typedMilliseconds, uniforms.typedUpdatesPerSecond / 1e6, uniforms.maxDifference);
+    return 0;
+}
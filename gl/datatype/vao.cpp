@@ -1,16 +1,29 @@
 #include "vao.h"
 
 #include "vbo.h"
+#include "vboattribmarker.h"
+#include "gl/shaders/shaderattriblocations.h"
 
 namespace CS123 { namespace GL {
 
+// Shaders read the model matrix of an instance from INSTANCE_MODEL. Outside of instanced draws
+// its arrays are disabled, so it has this value instead, and the model uniform alone applies.
+static void resetInstanceModel() {
+    for (GLuint column = 0; column < 4; column++) {
+        glVertexAttrib4f(ShaderAttrib::INSTANCE_MODEL + column, column == 0, column == 1, column == 2, column == 3);
+    }
+}
+
 VAO::VAO(const VBO &vbo, int numberOfVerticesToRender) :
     m_drawMethod(DRAW_ARRAYS),
     m_handle(0),
     m_numVertices(numberOfVerticesToRender),
     m_size(0),
-    m_triangleLayout(vbo.triangleLayout())
+    m_triangleLayout(vbo.triangleLayout()),
+    m_instanceHandle(0),
+    m_numInstances(0)
 {
+    resetInstanceModel();
     glGenVertexArrays(1, &m_handle);
 
     bind();
@@ -24,9 +37,13 @@ VAO::VAO(VAO &&that) :
     m_drawMethod(that.m_drawMethod),
     m_numVertices(that.m_numVertices),
     m_size(that.m_size),
-    m_triangleLayout(that.m_triangleLayout)
+    m_triangleLayout(that.m_triangleLayout),
+    m_instanceHandle(that.m_instanceHandle),
+    m_instanceAttributes(std::move(that.m_instanceAttributes)),
+    m_numInstances(that.m_numInstances)
 {
     that.m_handle = 0;
+    that.m_instanceHandle = 0;
 }
 
 VAO& VAO::operator=(VAO &&that) {
@@ -38,8 +55,12 @@ VAO& VAO::operator=(VAO &&that) {
     m_numVertices = that.m_numVertices;
     m_size = that.m_size;
     m_triangleLayout = that.m_triangleLayout;
+    m_instanceHandle = that.m_instanceHandle;
+    m_instanceAttributes = std::move(that.m_instanceAttributes);
+    m_numInstances = that.m_numInstances;
 
     that.m_handle = 0;
+    that.m_instanceHandle = 0;
 
     return *this;
 }
@@ -47,6 +68,7 @@ VAO& VAO::operator=(VAO &&that) {
 VAO::~VAO()
 {
     glDeleteVertexArrays(1, &m_handle);
+    glDeleteBuffers(1, &m_instanceHandle);
 }
 
 
@@ -65,6 +87,62 @@ void VAO::draw(int count) {
     }
 }
 
+/**
+ * Replaces the model matrices drawInstanced() draws the vertices with, one per instance.
+ * @param data column-major matrices, 16 floats each
+ * @param count number of matrices
+ */
+void VAO::setInstanceTransforms(const float *data, int count) {
+    std::vector<VBOAttribMarker> markers;
+    for (GLuint column = 0; column < 4; column++) {
+        markers.push_back(VBOAttribMarker(ShaderAttrib::INSTANCE_MODEL + column, 4, column * 4 * sizeof(GLfloat)));
+    }
+    setInstanceData(data, count, 16 * sizeof(GLfloat), markers, 1);
+}
+
+/**
+ * Replaces the per-instance data drawInstanced() draws the vertices with, and how it is laid out.
+ * @param data records of per-instance attributes
+ * @param count number of records
+ * @param stride size of a record in bytes
+ * @param markers where the attributes are in a record
+ * @param instancesPerRecord number of instances that draw with the same record
+ */
+void VAO::setInstanceData(const void *data, int count, GLsizei stride, const std::vector<VBOAttribMarker> &markers,
+                          GLuint instancesPerRecord) {
+    if (!m_instanceHandle) {
+        glGenBuffers(1, &m_instanceHandle);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceHandle);
+    glBufferData(GL_ARRAY_BUFFER, count * stride, data, GL_STATIC_DRAW);
+    bind();
+    m_instanceAttributes.clear();
+    for (const VBOAttribMarker &marker : markers) {
+        glVertexAttribPointer(marker.name, marker.numElements, marker.dataType, marker.dataNormalize, stride,
+                              reinterpret_cast<GLvoid*>(marker.offset));
+        glVertexAttribDivisor(marker.name, instancesPerRecord);
+        m_instanceAttributes.push_back(marker.name);
+    }
+    unbind();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_numInstances = count * instancesPerRecord;
+}
+
+// Draws every vertex once per instance in a single call. The VAO must be bound.
+void VAO::drawInstanced() {
+    if (m_numInstances == 0 || m_drawMethod != VAO::DRAW_ARRAYS) {
+        return;
+    }
+    for (GLuint location : m_instanceAttributes) {
+        glEnableVertexAttribArray(location);
+    }
+    glDrawArraysInstanced(m_triangleLayout, 0, m_numVertices, m_numInstances);
+    for (GLuint location : m_instanceAttributes) {
+        glDisableVertexAttribArray(location);
+    }
+    resetInstanceModel();
+}
+
 void VAO::bind() {
     glBindVertexArray(m_handle);
 }
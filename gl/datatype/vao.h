@@ -2,12 +2,14 @@
 #define VAO_H
 
 #include <memory>
+#include <vector>
 
 #include "GL/glew.h"
 
 namespace CS123 { namespace GL {
 
 class VBO;
+struct VBOAttribMarker;
 
 class VAO {
 public:
@@ -23,6 +25,10 @@ public:
     void bind();
     void draw();
     void draw(int count);
+    void setInstanceTransforms(const float *data, int count);
+    void setInstanceData(const void *data, int count, GLsizei stride, const std::vector<VBOAttribMarker> &markers,
+                         GLuint instancesPerRecord);
+    void drawInstanced();
     DRAW_METHOD drawMethod();
     void unbind();
 
@@ -34,6 +40,9 @@ private:
     GLuint m_numVertices;
     int m_size;
     GLenum m_triangleLayout;
+    GLuint m_instanceHandle; // buffer of the per-instance data, 0 until there is some
+    std::vector<GLuint> m_instanceAttributes; // attribute locations read from it
+    int m_numInstances;
 };
 
 }}
@@ -6,7 +6,7 @@
 namespace CS123 { namespace GL {
 
 struct VBOAttribMarker {
-    enum DATA_TYPE{ FLOAT = GL_FLOAT, INT = GL_INT, UNSIGNED_BYTE = GL_UNSIGNED_BYTE };
+    enum DATA_TYPE{ FLOAT = GL_FLOAT, INT = GL_INT, SHORT = GL_SHORT, UNSIGNED_BYTE = GL_UNSIGNED_BYTE };
     enum DATA_NORMALIZE{ GLTRUE = GL_TRUE, GLFALSE = GL_FALSE };
 
     /**
@@ -14,7 +14,7 @@ struct VBOAttribMarker {
      * @param name OpenGL handle to the attribute location. These are specified in ShaderAttribLocations.h
      * @param numElementsPerVertex Number of elements per vertex. Must be 1, 2, 3 or 4 (e.g. position = 3 for x,y,z)
      * @param offset Offset in BYTES from the start of the array to the beginning of the first element
-     * @param type Primitive type (FLOAT, INT, UNSIGNED_BYTE)
+     * @param type Primitive type (FLOAT, INT, SHORT, UNSIGNED_BYTE)
      * @param normalize
      */
     VBOAttribMarker(GLuint name, GLuint numElementsPerVertex, int offset, DATA_TYPE type = FLOAT, bool normalize = false);
@@ -17,6 +17,14 @@ namespace CS123 { namespace GL { namespace ShaderAttrib {
     const GLuint TEXCOORD = 2;
     const GLuint TANGENT = 3;
 
+    // Per-instance model matrix of instanced draws. A mat4 takes four locations, one per column.
+    const GLuint INSTANCE_MODEL = 4;
+
+    // Per-tip attributes of the leaves drawn from branch tips (leaf_tip.vert), in place of INSTANCE_MODEL
+    const GLuint TIP_POSITION = 4;
+    const GLuint TIP_ORIENTATION = 5;
+    const GLuint TIP_AXIS = 6;
+
 }}}
 
 #endif // SHADERATTRIBLOCATIONS_H
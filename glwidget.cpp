@@ -1,6 +1,5 @@
 #include "glwidget.h"
 #include <QMouseEvent>
-#include <sstream>
 
 #include "shapes/Island.h"
 #include "shapes/RoundedCylinder.h"
@@ -11,12 +10,14 @@
 #include "camera/orbitingcamera.h"
 #include "lib/resourceloader.h"
 #include "uniforms/varsfile.h"
+#include "uniforms/uniformcache.h"
 #include "gl/shaders/shaderattriblocations.h"
 #include "glm/gtc/type_ptr.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/glm.hpp"            // glm::vec*, mat*, and basic glm functions
 #include "glm/gtx/transform.hpp"  // glm::translate, scale, rotate
 #include "glm/gtc/type_ptr.hpp" // glm::value_ptr
+#include <cstddef>
 
 UniformVariable *GLWidget::s_skybox = NULL;
 UniformVariable *GLWidget::s_projection = NULL;
@@ -33,10 +34,17 @@ std::vector<UniformVariable*> *GLWidget::s_staticVars = NULL;
 
 QGLShaderProgram *selected_shader = nullptr;
 
+// Largest amount of transform data a tree may produce before a rebuild is refused.
+const double GLWidget::TREE_MEMORY_BUDGET = 512.0 * 1024 * 1024;
+
 GLWidget::GLWidget(QGLFormat format, QWidget *parent)
     : QGLWidget(format, parent), m_sphere(nullptr), m_cube(nullptr), m_shape(nullptr), skybox_cube(nullptr),
-      m_tree(std::make_unique<Tree>()),
-      m_textureID(0)
+      m_treeBuilder(std::make_unique<TreeBuilder>()),
+      m_leafMode(LEAF_TIPS),
+      m_requestedLeafMode(LEAF_TIPS),
+      m_drawLeafTips(false),
+      m_textureID(0),
+      m_uniformUploads({ 0, 0 })
 {
     camera = new OrbitingCamera();
     QObject::connect(camera, SIGNAL(viewChanged(glm::mat4)), this, SLOT(viewChanged(glm::mat4)));
@@ -145,6 +153,7 @@ void GLWidget::initializeGL() {
     wireframe_shader = ResourceLoader::newShaderProgram(context(), ":/shaders/standard.vert", ":/shaders/color.frag");
     phong_shader = ResourceLoader::newShaderProgram(context(), ":/shaders/light.vert", ":/shaders/light.frag");
     leaf_shader = ResourceLoader::newShaderProgram(context(), ":/shaders/leaf.vert", ":/shaders/leaf.frag");
+    leaf_tip_shader = ResourceLoader::newShaderProgram(context(), ":/shaders/leaf_tip.vert", ":/shaders/leaf.frag");
     normal_mapping_shader = ResourceLoader::newShaderProgram(context(), ":/shaders/normal_map.vert", ":/shaders/normal_map.frag");
     island_shader = ResourceLoader::newShaderProgram(context(), ":/shaders/island.vert", ":/shaders/island.frag");
     glass_shader = ResourceLoader::newShaderProgram(context(), ":/shaders/glass.vert", ":/shaders/glass.frag");
@@ -286,7 +295,8 @@ void GLWidget::initializeGL() {
 
 void GLWidget::resizeGL(int w, int h) {
     glViewport(0, 0, w, h);
-    s_size->parse(QString("%1,%2").arg(QString::number(w), QString::number(h)));
+    GLfloat size[2] = { (GLfloat) w, (GLfloat) h };
+    s_size->setFloats(size, 2);
     camera->setAspectRatio(((float) w) / ((float) h));
     update();
 }
@@ -354,7 +364,7 @@ void GLWidget::renderWireframe() {
         case WIREFRAME_NORMAL:
             wireframe_shader->bind();
             s_mvp->setValue(wireframe_shader);
-            wireframe_shader->setUniformValue("color", 0, 0, 0, 1);
+            UniformCache::setFloats(wireframe_shader->programId(), "color", glm::value_ptr(glm::vec4(0, 0, 0, 1)), 4, 1);
             m_shape->draw();
             wireframe_shader->release();
             break;
@@ -363,7 +373,7 @@ void GLWidget::renderWireframe() {
             foreach (const UniformVariable *var, *activeUniforms) {
                 var->setValue(wireframe_shader2);
             }
-            wireframe_shader2->setUniformValue("color", 0, 0, 0, 1);
+            UniformCache::setFloats(wireframe_shader2->programId(), "color", glm::value_ptr(glm::vec4(0, 0, 0, 1)), 4, 1);
             m_shape->draw();
             wireframe_shader2->release();
             break;
@@ -372,78 +382,84 @@ void GLWidget::renderWireframe() {
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
 }
+// Uploads the transforms of the tree being drawn as the instances of the shapes that draw it.
+// Only called when a tree with another generation replaces it, so a still tree uploads nothing.
+void GLWidget::uploadTree() {
+    m_cylinder->setInstanceData(m_tree->branches->body);
+    m_cone->setInstanceData(m_tree->branches->tip);
+
+    // Without leaf transforms, every tip is drawn as the leaves at its end (see leaf_tip.vert)
+    m_drawLeafTips = !m_tree->drawnLeaves;
+    if (m_drawLeafTips) {
+        std::vector<VBOAttribMarker> markers = {
+            VBOAttribMarker(ShaderAttrib::TIP_POSITION, 3, offsetof(LeafTip, position)),
+            VBOAttribMarker(ShaderAttrib::TIP_ORIENTATION, 4, offsetof(LeafTip, orientation), VBOAttribMarker::SHORT, true),
+            VBOAttribMarker(ShaderAttrib::TIP_AXIS, 1, offsetof(LeafTip, axis), VBOAttribMarker::UNSIGNED_BYTE, false),
+        };
+        const std::vector<LeafTip> &tips = *m_tree->leafTips;
+        m_cube->setInstanceData(tips.data(), tips.size(), sizeof(LeafTip), markers, m_tree->leavesPerTip);
+    } else {
+        m_cube->setInstanceData(*m_tree->drawnLeaves);
+    }
+}
+
 void GLWidget::renderBranches() {
     //  Note: the wireframes won't work because it's not connected to that,
     // must choose a shader to get it working.
 
-    std::vector<glm::mat4> body = m_tree->getBranchData().body;
+    // Every branch carries its whole transform as an instance attribute (see uploadTree), so the
+    // bodies and the tips are one instanced draw each, with the identity as the model uniform.
     glm::mat4 original = model;
-    RenderType oldRenderType = m_renderMode;
-
-    changeRenderMode(SHAPE_CYLINDER);
-    for (int i = 0; i < static_cast<int>(body.size()); i++) {
-        model = body[i];
-        modelChanged(model);
-        modelviewProjectionChanged(camera->getProjectionMatrix() * camera->getModelviewMatrix());
-        // TODO: restore as current_shader
-        bindAndUpdateShader(selected_shader); // needed before calling draw.
-
-        glBindTexture(GL_TEXTURE_2D, m_textureID);
-        m_shape->draw();
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-    }
-
-    changeRenderMode(SHAPE_CONE);
-    std::vector<glm::mat4> tips = m_tree->getBranchData().tip;
-
-    for (int i = 0; i < static_cast<int>(tips.size()); i++) {
-        model = tips[i];
-        modelChanged(model);
-        modelviewProjectionChanged(camera->getProjectionMatrix() * camera->getModelviewMatrix());
+    model = glm::mat4();
+    modelChanged(model);
+    modelviewProjectionChanged(camera->getProjectionMatrix() * camera->getModelviewMatrix());
+    // TODO: restore as current_shader
+    bindAndUpdateShader(selected_shader); // needed before calling draw.
 
-        // TODO: restore as current_shader
-        bindAndUpdateShader(selected_shader); // needed before calling draw.
-        glBindTexture(GL_TEXTURE_2D, m_textureID);
-        m_shape->draw();
-        glBindTexture(GL_TEXTURE_2D, 0);
-    }
+    glBindTexture(GL_TEXTURE_2D, m_textureID);
+    m_cylinder->drawInstanced();
+    m_cone->drawInstanced();
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    changeRenderMode(oldRenderType);
     model = original; // resets model back to the init
     // TODO: restore as current_shader
     releaseShader(selected_shader);
 }
 
 void GLWidget::renderLeaves() {
-    std::vector<glm::mat4> trans = m_tree->getLeafData();
-
-    glm::mat4 oldModel = model;
+    // Like the branches, all the leaves are one instanced draw of the leaf shape (m_cube), either
+    // from the leaves the tree builder compacted or from the branch tips. They all share the color
+    // of the season.
+    QGLShaderProgram *shader = m_drawLeafTips ? leaf_tip_shader : leaf_shader;
     glm::mat4 original = model;
-    RenderType oldRenderType = m_renderMode;
+    model = glm::mat4();
+    modelChanged(model);
+    modelviewProjectionChanged(camera->getProjectionMatrix() * camera->getModelviewMatrix());
+    bindAndUpdateShader(shader); // needed before calling draw.
 
-    changeRenderMode(SHAPE_LEAF);
-    for (int i = 0; i < static_cast<int>(trans.size()); i++) {
-        model = trans[i];
-        modelChanged(model);
-        modelviewProjectionChanged(camera->getProjectionMatrix() * camera->getModelviewMatrix());
-
-        //Set color based on season
-        if (settings.season == 0){
-            leaf_shader->setUniformValue("color", QVector4D(0.13f, 0.54f, 0.12f, 0.f));
-        } else if (settings.season == 1){
-            leaf_shader->setUniformValue("color", QVector4D(0.9f, 0.6f, 0.3f, 0.f));
-        } else {
-            leaf_shader->setUniformValue("color", QVector4D(0.2f, 0.8f, 0.3f, 0.f));
-        }
+    if (m_drawLeafTips) {
+        // The leaf size only changes these few transforms, so it needs no rebuild
+        std::vector<glm::mat4> bases = Tree::getLeafBases(m_tree->model, settings.leafSize);
+        UniformCache::setMatrices(shader->programId(), "leafBases", glm::value_ptr(bases[0]), 4, bases.size(), GL_FALSE);
+        UniformCache::setInt(shader->programId(), "leavesPerTip", m_tree->leavesPerTip);
+    }
 
-        bindAndUpdateShader(leaf_shader); // needed before calling draw.
-        m_shape->draw();
+    //Set color based on season
+    glm::vec4 color;
+    if (settings.season == 0){
+        color = glm::vec4(0.13f, 0.54f, 0.12f, 0.f);
+    } else if (settings.season == 1){
+        color = glm::vec4(0.9f, 0.6f, 0.3f, 0.f);
+    } else {
+        color = glm::vec4(0.2f, 0.8f, 0.3f, 0.f);
     }
+    UniformCache::setFloats(shader->programId(), "color", glm::value_ptr(color), 4, 1);
+
+    m_cube->drawInstanced();
+
     // reset states
-    changeRenderMode(oldRenderType); // honestly not sure if this should happen in for loop :0
     model = original;
-    releaseShader(leaf_shader);
+    releaseShader(shader);
 }
 
 
@@ -455,13 +471,15 @@ void GLWidget::renderSingleLeaf() {
     bindAndUpdateShader(leaf_shader);
 
     //Set color based on season
+    glm::vec4 color;
     if (settings.season == 0){
-        leaf_shader->setUniformValue("color", QVector4D(0.2f, .8f, 0.3f, 0.f));
+        color = glm::vec4(0.2f, .8f, 0.3f, 0.f);
     } else if (settings.season == 1){
-        leaf_shader->setUniformValue("color", QVector4D(0.9f, 0.6f, 0.3f, 0.f));
+        color = glm::vec4(0.9f, 0.6f, 0.3f, 0.f);
     } else {
-        leaf_shader->setUniformValue("color", QVector4D(0.2f, 0.8f, 0.3f, 0.f));
+        color = glm::vec4(0.2f, 0.8f, 0.3f, 0.f);
     }
+    UniformCache::setFloats(leaf_shader->programId(), "color", glm::value_ptr(color), 4, 1);
 
     m_shape->draw();
     releaseShader(leaf_shader);
@@ -485,17 +503,20 @@ void GLWidget::renderIsland() {
     changeRenderMode(oldRenderType);
 }
 
-// TODO: any changes to the UI component should also add to this function.
+// TODO: any changes to the UI component that the tree is built from should also add to this function.
+// Season and bump mapping are only used when drawing, so they do not rebuild the tree, and neither
+// does the leaf size when the leaves are drawn from the branch tips. The tree itself only redoes
+// the stages that depend on the settings that changed.
 bool GLWidget::hasSettingsChanged() {
     if (m_settings.treeOption != settings.treeOption){
         m_settings.treeOption = settings.treeOption;
         return true;
     }
-
-    if (m_settings.season != settings.season){
-        m_settings.season = settings.season;
+    if (m_settings.seed != settings.seed){
+        m_settings.seed = settings.seed;
         return true;
     }
+
     if (m_settings.recursions != settings.recursions ||
             m_settings.angle != settings.angle) {
         m_settings.recursions = settings.recursions;
@@ -503,15 +524,24 @@ bool GLWidget::hasSettingsChanged() {
         return true;
     } if (m_settings.leafSize != settings.leafSize) {
         m_settings.leafSize = settings.leafSize;
-        return true;
-    } if (m_settings.ifBumpMap != settings.ifBumpMap) {
-        m_settings.ifBumpMap = settings.ifBumpMap;
-        return true;
+        return m_leafMode == LEAF_MATRICES;
     }
 
     return false;
 }
 
+// Checks the predicted size of the tree for the current settings against the memory budget.
+// If it is too large, the previous tree is kept.
+bool GLWidget::treeFitsMemoryBudget() {
+    double bytes = Tree::predictOutputBytes(settings.treeOption, settings.recursions);
+    if (bytes > TREE_MEMORY_BUDGET) {
+        std::cout << "Recursion depth " << settings.recursions << " would need about "
+                  << static_cast<int>(bytes / (1024 * 1024)) << " MB of transforms, keeping the previous tree" << std::endl;
+        return false;
+    }
+    return true;
+}
+
 void GLWidget::renderSkybox() {
     skybox_shader->bind();
     s_skybox->setValue(skybox_shader);
@@ -524,6 +554,12 @@ void GLWidget::renderSkybox() {
 }
 
 void GLWidget::paintGL() {
+    UniformCache::beginFrame();
+    UniformUploads uploads = UniformCache::lastFrame();
+    if (uploads.uploaded != m_uniformUploads.uploaded || uploads.skipped != m_uniformUploads.skipped) {
+        m_uniformUploads = uploads;
+        emit(uniformUploadsChanged(uploads.uploaded, uploads.skipped));
+    }
     handleAnimation();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -532,13 +568,25 @@ void GLWidget::paintGL() {
 
     if (m_shape) {
         if (m_renderMode == SHAPE_TREE) {
-            if (hasSettingsChanged()) {
-                m_tree->buildTree(model, settings.leafSize);
-            } else {
+            // The tree builds in the background; the last one built is drawn until the new one is ready
+            bool changed = hasSettingsChanged();
+            if (m_leafMode != m_requestedLeafMode) {
+                m_requestedLeafMode = m_leafMode;
+                changed = true;
+            }
+            if (changed && treeFitsMemoryBudget()) {
+                m_treeBuilder->request(settings, model, m_leafMode == LEAF_MATRICES);
+            }
+            std::shared_ptr<const TreeSnapshot> built = m_treeBuilder->takeFinished();
+            if (built && (!m_tree || built->generation != m_tree->generation)) {
+                m_tree = built;
+                uploadTree();
+            }
+            if (m_tree) {
                 renderBranches();
                 renderLeaves();
-                renderIsland();
             }
+            renderIsland();
         } else {// todo: remove this once texture mapping is done, along with the corresponding button.
 
             bindAndUpdateShader(selected_shader);
@@ -603,6 +651,12 @@ void GLWidget::setWireframeMode(WireframeType mode)
     wireframeMode = mode;
 }
 
+// Switches how leaves are drawn. The tree is requested again with or without leaf transforms.
+void GLWidget::setLeafMode(LeafMode mode)
+{
+    m_leafMode = mode;
+}
+
 bool GLWidget::loadShader(QString vert, QString frag, QString *errors)
 {
     QGLShaderProgram *new_shader = ResourceLoader::newShaderProgram(context(), vert, frag, errors);
@@ -610,7 +664,7 @@ bool GLWidget::loadShader(QString vert, QString frag, QString *errors)
         return false;
     }
 
-    delete wireframe_shader2;
+    ResourceLoader::deleteShaderProgram(wireframe_shader2);
     wireframe_shader2 = ResourceLoader::newShaderProgram(context(), vert, ":/shaders/color.frag", errors);
 
     UniformVariable::s_numTextures = 2;
@@ -637,7 +691,7 @@ bool GLWidget::loadShader(QString vert, QString frag, QString *errors)
         emit(addUniform(uniformType, qname, true, arraySize));
     }
 
-    delete current_shader;
+    ResourceLoader::deleteShaderProgram(current_shader);
     current_shader = new_shader;
     camera->mouseScrolled(0);
     camera->updateMats();
@@ -665,50 +719,22 @@ void GLWidget::uniformAdded(const UniformVariable *uniform)
 
 void GLWidget::viewChanged(const glm::mat4 &modelview)
 {
-    std::stringstream s;
-    const float *data = glm::value_ptr(glm::transpose(modelview));
-    for (int i = 0; i < 16; i++) {
-        s << data[i];
-        if (i < 15)
-            s << ",";
-    }
-    s_view->parse(QString::fromStdString(s.str()));
+    s_view->setMat4(modelview);
 }
 
 void GLWidget::projectionChanged(const glm::mat4 &projection)
 {
-    std::stringstream s;
-    const float *data = glm::value_ptr(glm::transpose(projection));
-    for (int i = 0; i < 16; i++) {
-        s << data[i];
-        if (i < 15)
-            s << ",";
-    }
-    s_projection->parse(QString::fromStdString(s.str()));
+    s_projection->setMat4(projection);
 }
 
 void GLWidget::modelviewProjectionChanged(const glm::mat4 &modelviewProjection)
 {
-    std::stringstream s;
-    const float *data = glm::value_ptr(glm::transpose(modelviewProjection * model));
-    for (int i = 0; i < 16; i++) {
-        s << data[i];
-        if (i < 15)
-            s << ",";
-    }
-    s_mvp->parse(QString::fromStdString(s.str()));
+    s_mvp->setMat4(modelviewProjection * model);
 }
 
 void GLWidget::modelChanged(const glm::mat4 &modelview)
 {
-    std::stringstream s;
-    const float *data = glm::value_ptr(glm::transpose(modelview));
-    for (int i = 0; i < 16; i++) {
-        s << data[i];
-        if (i < 15)
-            s << ",";
-    }
-    s_model->parse(QString::fromStdString(s.str()));
+    s_model->setMat4(modelview);
 }
 
 void GLWidget::setPaused(bool paused)
@@ -724,10 +750,12 @@ void GLWidget::mouseMoveEvent(QMouseEvent *event) {
     if (event->buttons() & Qt::LeftButton) {
         camera->mouseDragged(event->x(), event->y());
     }
-    s_mouse->parse(QString("%1,%2,%3").arg(
-                       QString::number(event->x()),
-                       QString::number(event->y()),
-                       QString::number(mouseDown)));
+    updateMouse(event);
+}
+
+void GLWidget::updateMouse(QMouseEvent *event) {
+    GLfloat mouse[3] = { (GLfloat) event->x(), (GLfloat) event->y(), (GLfloat) mouseDown };
+    s_mouse->setFloats(mouse, 3);
 }
 
 void GLWidget::wheelEvent(QWheelEvent *event)
@@ -738,16 +766,10 @@ void GLWidget::wheelEvent(QWheelEvent *event)
 void GLWidget::mousePressEvent(QMouseEvent *event) {
     camera->mouseDown(event->x(), event->y());
     mouseDown = true;
-    s_mouse->parse(QString("%1,%2,%3").arg(
-                       QString::number(event->x()),
-                       QString::number(event->y()),
-                       QString::number(mouseDown)));
+    updateMouse(event);
 }
 
 void GLWidget::mouseReleaseEvent(QMouseEvent *event) {
     mouseDown = false;
-    s_mouse->parse(QString("%1,%2,%3").arg(
-                       QString::number(event->x()),
-                       QString::number(event->y()),
-                       QString::number(mouseDown)));
+    updateMouse(event);
 }
@@ -4,10 +4,11 @@
 #include "shapes/openglshape.h"
 #include "camera/camera.h"
 #include "uniforms/uniformvariable.h"
+#include "uniforms/uniformcache.h"
 #include <QTimer>
 #include "shapes/Shape.h"
 #include "shapes/Cylinder.h"
-#include "tree/Tree.h"
+#include "tree/TreeBuilder.h"
 #include "Settings.h"
 
 class Cube;
@@ -22,6 +23,9 @@ enum AnimType { ANIM_NONE, ANIM_MOVE, ANIM_SCALE, ANIM_MOVE_AND_SCALE, ANIM_ROTA
 
 enum WireframeType { WIREFRAME_NORMAL, WIREFRAME_VERT };
 
+// How leaves are drawn: from a transform per leaf, or expanded on the GPU from the branch tips
+enum LeafMode { LEAF_MATRICES, LEAF_TIPS };
+
 class GLWidget : public QGLWidget
 {
     Q_OBJECT
@@ -52,6 +56,7 @@ signals:
     void addUniform(UniformVariable *uniform, bool editable = true);
     void changeUniform(const UniformVariable *uniform, const QString &newVal);
     void changeUniform(const QString &name, const QString &newVal);
+    void uniformUploadsChanged(unsigned uploaded, unsigned skipped);
 
 
 public slots:
@@ -59,6 +64,7 @@ public slots:
     void changeAnimMode(AnimType mode);
     void toggleDrawWireframe(bool draw);
     void setWireframeMode(WireframeType mode);
+    void setLeafMode(LeafMode mode);
     bool loadShader(QString vert, QString frag, QString *errors = 0);
     void uniformDeleted(const UniformVariable *uniform);
     void uniformAdded(const UniformVariable *uniform);
@@ -76,20 +82,25 @@ protected:
     void mouseReleaseEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
     void wheelEvent(QWheelEvent *event);
+    void updateMouse(QMouseEvent *event);
 
     void buildTree();
     void bindAndUpdateShader(QGLShaderProgram *shader);
     void releaseShader(QGLShaderProgram *shader);
 
     void renderWireframe();
+    void uploadTree();
     void renderBranches();
     void renderLeaves();
     void renderSkybox();
     void renderIsland();
     void renderSingleLeaf();
     bool hasSettingsChanged();
+    bool treeFitsMemoryBudget();
 
 private:
+    static const double TREE_MEMORY_BUDGET;
+
     std::unique_ptr<OpenGLShape> m_leaf;
     std::unique_ptr<OpenGLShape> m_sphere;
     std::unique_ptr<OpenGLShape> m_cylinder;
@@ -109,6 +120,7 @@ private:
     QGLShaderProgram *phong_shader;
 
     QGLShaderProgram *leaf_shader;
+    QGLShaderProgram *leaf_tip_shader;
     QGLShaderProgram *normal_mapping_shader;
     QGLShaderProgram *island_shader;
     QGLShaderProgram *glass_shader;
@@ -136,8 +148,13 @@ private:
     RenderType m_renderMode;
 
     bool mouseDown;
-    std::unique_ptr<Tree> m_tree;// Tree with L System
+    std::unique_ptr<TreeBuilder> m_treeBuilder; // Builds the tree with L System off the render thread
+    std::shared_ptr<const TreeSnapshot> m_tree; // Tree being drawn, replaced when a newer one is built
+    LeafMode m_leafMode;
+    LeafMode m_requestedLeafMode; // leaf mode of the last tree requested
+    bool m_drawLeafTips;          // whether the leaves uploaded for m_tree are its leaf tips
     GLuint m_textureID;
+    UniformUploads m_uniformUploads; // last frame counts sent with uniformUploadsChanged()
     Settings m_settings;  // Local version of settings to keep track of changes.
 
 };
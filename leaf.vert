@@ -1,7 +1,8 @@
 #version 400 core
 
-in vec3 position;
-in vec3 normal;
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 4) in mat4 instanceModel; // identity unless drawn instanced
 
 out vec3 fragPos;
 
@@ -10,7 +11,7 @@ uniform mat4 model;
 uniform mat4 trans;
 
 void main(void) {
-    fragPos = (model * vec4(position, 1)).xyz;
-    vec4 pos = mvp * vec4(position, 1);
+    fragPos = (model * instanceModel * vec4(position, 1)).xyz;
+    vec4 pos = mvp * instanceModel * vec4(position, 1);
     gl_Position = pos;
 }
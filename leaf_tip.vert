@@ -0,0 +1,40 @@
+#version 400 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+
+// One branch tip (see LeafTip) for every leavesPerTip instances
+layout (location = 4) in vec3 tipPosition;
+layout (location = 5) in vec4 tipOrientation; // quaternion x, y, z, w
+layout (location = 6) in float tipAxis;       // rotation axis the side leaves turn on
+
+out vec3 fragPos;
+
+uniform mat4 mvp;
+uniform mat4 model;
+uniform int leavesPerTip;
+// Tree::getLeafBases(): the top leaf, then the left leaves and the right leaves for each of the 5 axes
+uniform mat4 leafBases[11];
+
+// Same as glm::mat3_cast
+mat3 rotation(vec4 q) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    return mat3(1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy),
+                2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx),
+                2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy));
+}
+
+void main(void) {
+    int slot = gl_InstanceID % leavesPerTip;
+    int axis = int(tipAxis + .5);
+    int base = slot == 0 ? 0 : slot == 1 ? 1 + axis : 6 + axis;
+
+    mat4 placement = mat4(rotation(normalize(tipOrientation)));
+    placement[3] = vec4(tipPosition, 1);
+    mat4 leaf = placement * leafBases[base];
+
+    fragPos = (model * leaf * vec4(position, 1)).xyz;
+    gl_Position = mvp * leaf * vec4(position, 1);
+}
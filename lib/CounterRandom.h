@@ -0,0 +1,51 @@
+#ifndef COUNTERRANDOM_H
+#define COUNTERRANDOM_H
+
+#include <cstdint>
+
+/**
+ * Stateless, counter-based random numbers.
+ *
+ * A draw is a hash of (seed, stream, counter) rather than the next value of a stateful engine, so
+ * the same key always gives the same number no matter how many draws came before it or which
+ * thread makes them. Streams keep unrelated users of one seed apart (e.g. one stream per L-system
+ * generation, another one for branch angles).
+ */
+class CounterRandom
+{
+public:
+    explicit CounterRandom(uint32_t seed = 0) : m_seed(seed) {}
+
+    void setSeed(uint32_t seed) { m_seed = seed; }
+    uint32_t getSeed() const { return m_seed; }
+
+    // Returns 32 uniformly distributed bits for the given key.
+    uint32_t next(uint32_t stream, uint64_t counter) const {
+        uint64_t x = mix(m_seed * 0x9E3779B97F4A7C15ull + stream);
+        return static_cast<uint32_t>(mix(x ^ counter) >> 32);
+    }
+
+    // Returns an integer uniformly distributed in [0, maxIndex].
+    int uniformInt(int maxIndex, uint32_t stream, uint64_t counter) const {
+        uint64_t range = static_cast<uint64_t>(maxIndex) + 1;
+        return static_cast<int>((next(stream, counter) * range) >> 32);
+    }
+
+    // Returns a float uniformly distributed in [0, 1).
+    float uniformFloat(uint32_t stream, uint64_t counter) const {
+        return (next(stream, counter) >> 8) * (1.f / 16777216.f);
+    }
+
+private:
+    // SplitMix64 finalizer.
+    static uint64_t mix(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    uint32_t m_seed;
+};
+
+#endif // COUNTERRANDOM_H
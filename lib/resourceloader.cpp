@@ -1,4 +1,5 @@
 #include "resourceloader.h"
+#include "uniforms/uniformcache.h"
 
 /**
   Loads the cube map into video memory.
@@ -91,7 +92,9 @@ QGLShaderProgram * ResourceLoader::newVertShaderProgram(const QGLContext *contex
 {
     QGLShaderProgram *program = new QGLShaderProgram(context);
     program->addShaderFromSourceFile(QGLShader::Vertex, vertShader);
-    program->link();
+    if (program->link()) {
+        UniformCache::addProgram(program->programId());
+    }
     return program;
 }
 
@@ -102,12 +105,15 @@ QGLShaderProgram * ResourceLoader::newFragShaderProgram(const QGLContext *contex
 {
     QGLShaderProgram *program = new QGLShaderProgram(context);
     program->addShaderFromSourceFile(QGLShader::Fragment, fragShader);
-    program->link();
+    if (program->link()) {
+        UniformCache::addProgram(program->programId());
+    }
     return program;
 }
 
 /**
-    Creates a shader program from both vert and frag shaders
+    Creates a shader program from both vert and frag shaders, and looks up the locations of its
+    uniforms in UniformCache
   **/
 QGLShaderProgram * ResourceLoader::newShaderProgram(const QGLContext *context, QString vertShader, QString fragShader, QString *errors)
 {
@@ -136,9 +142,21 @@ QGLShaderProgram * ResourceLoader::newShaderProgram(const QGLContext *context, Q
         delete program;
         return NULL;
     }
+    UniformCache::addProgram(program->programId());
     return program;
 }
 
+/**
+    Deletes a shader program made by one of the functions above
+  **/
+void ResourceLoader::deleteShaderProgram(QGLShaderProgram *program)
+{
+    if (program) {
+        UniformCache::removeProgram(program->programId());
+        delete program;
+    }
+}
+
 void ResourceLoader::initializeGlew() {
     glewExperimental = GL_TRUE;
     GLenum err = glewInit();
@@ -20,6 +20,8 @@ namespace ResourceLoader
     QGLShaderProgram * newVertShaderProgram(const QGLContext *context, QString vertShader);
     QGLShaderProgram * newFragShaderProgram(const QGLContext *context, QString fragShader);
     QGLShaderProgram * newShaderProgram(const QGLContext *context, QString vertShader, QString fragShader, QString *errors = 0);
+    // Deletes a program and forgets its uniforms, so a new program can get its id
+    void deleteShaderProgram(QGLShaderProgram *program);
 
     // Returns the cubeMap ID
     GLuint loadCubeMap(QList<QFile *> files);
@@ -4,6 +4,7 @@ layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 tangent;
+layout (location = 4) in mat4 instanceModel; // identity unless drawn instanced
 
 out vec3 fragPos;
 out vec3 surfaceNormal;
@@ -20,12 +21,13 @@ const vec3 testLightPos = vec3(0, 0, 3);
 //uniform vec3 lightPos;
 
 void main(void) {
-    vec4 pos = mvp * vec4(position, 1);
+    mat4 world = model * instanceModel;
+    vec4 pos = mvp * instanceModel * vec4(position, 1);
     gl_Position = pos;
 
-    fragPos = (model * vec4(position, 1.0)).xyz;
+    fragPos = (world * vec4(position, 1.0)).xyz;
     surfaceNormal = normal;
     texCoords = aTexCoords;
     lightPos = testLightPos;
-    viewPos = (inverse(view) * -1.0 * view * model * vec4(position, 0.0)).xyz;
+    viewPos = (inverse(view) * -1.0 * view * world * vec4(position, 0.0)).xyz;
 }
@@ -4,6 +4,7 @@
 
 #include <QMessageBox>
 #include <QSettings>
+#include <QStatusBar>
 #include "Databinding.h"
 #include "Settings.h"
 
@@ -40,6 +41,7 @@ MainWindow::MainWindow(QWidget *parent) :
     QObject::connect(m_glwidget, SIGNAL(addUniform(UniformVariable*,bool)), this, SLOT(addUniform(UniformVariable*,bool)));
     QObject::connect(m_glwidget, SIGNAL(changeUniform(const UniformVariable*,QString)), this, SLOT(changeUniform(const UniformVariable*,QString)));
     QObject::connect(m_glwidget, SIGNAL(changeUniform(QString,QString)), this, SLOT(changeUniform(QString,QString)));
+    QObject::connect(m_glwidget, SIGNAL(uniformUploadsChanged(unsigned,unsigned)), this, SLOT(showUniformUploads(unsigned,unsigned)));
 
     this->m_initShader = m_initShader;
 
@@ -130,6 +132,7 @@ void MainWindow::init()
     ui->treeOptionsComboBox->addItem("Wavy Seaweed");
     ui->treeOptionsComboBox->addItem("Twiggy Weed");
     ui->treeOptionsComboBox->addItem("Stochastic Fuzzy Weed");
+    ui->treeOptionsComboBox->addItem("Parametric Tree");
 }
 
 void MainWindow::handleUniformDeleted(UniformWidget *deleted)
@@ -241,6 +244,12 @@ void MainWindow::on_bumpMapCheckbox_clicked()
    settings.ifBumpMap = !settings.ifBumpMap;
 }
 
+// Draws the leaves from the branch tips, expanded in the vertex shader, or from a matrix per leaf.
+void MainWindow::on_leafTipsCheckbox_toggled(bool checked)
+{
+    m_glwidget->setLeafMode(checked ? LEAF_TIPS : LEAF_MATRICES);
+}
+
 void MainWindow::updateSeasonParameters(int season){
     switch (season){
         //Summer
@@ -283,6 +292,7 @@ void MainWindow::dataBind(){
         ui->recursionsSlider, ui->recursionsTextbox, settings.recursions, 0, 10));
     BIND(FloatBinding::bindSliderAndTextbox(
         ui->angleSlider, ui->angleTextbox, settings.angle, 10, 90));
+    BIND(IntBinding::bindSpinBox(ui->seedSpinBox, settings.seed, 0, 999999));
 
     BIND(FloatBinding::bindSliderAndTextbox(
         ui->leafSizeSlider, ui->leafSizeTextbox, settings.leafSize, 0, 7));
@@ -294,6 +304,16 @@ void MainWindow::settingsChanged(){
 
 }
 
+/**
+ * Shows in the status bar how many uniforms were uploaded in the last frame, and how many uploads
+ * were skipped because the shader already had the value.
+ * @brief MainWindow::showUniformUploads
+ */
+void MainWindow::showUniformUploads(unsigned uploaded, unsigned skipped)
+{
+    statusBar()->showMessage(QString("Uniforms per frame: %1 uploaded, %2 skipped").arg(uploaded).arg(skipped));
+}
+
 void MainWindow::on_treeOptionsComboBox_activated(const QString &arg1)
 {
 
@@ -59,6 +59,8 @@ private slots:
 
     void on_bumpMapCheckbox_clicked();
 
+    void on_leafTipsCheckbox_toggled(bool checked);
+
 public slots:
     void handleUniformDeleted(UniformWidget *deleted);
     void changeUniform(const UniformVariable *uniform, const QString &newVal);
@@ -66,6 +68,7 @@ public slots:
     void addUniform(UniformVariable::Type type, const QString &name, bool editable = false, int size = 1);
     void addUniform(UniformVariable *uniform, bool editable = false);
     void settingsChanged();
+    void showUniformUploads(unsigned uploaded, unsigned skipped);
 
 protected:
     void closeEvent(QCloseEvent *e);
@@ -4,6 +4,7 @@ layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 tangent;
+layout (location = 4) in mat4 instanceModel; // identity unless drawn instanced
 
 out vec3 tangentFragPos;
 out vec2 texCoords;
@@ -20,20 +21,21 @@ uniform mat4 view;
 const vec3 lightPos = vec3(0, 0, 3);
 
 void main(void) {
-    vec4 pos = mvp * vec4(position, 1);
+    mat4 world = model * instanceModel;
+    vec4 pos = mvp * instanceModel * vec4(position, 1);
     gl_Position = pos;
 
-    vec3 N = normalize(vec3(model * vec4(normal, 0.0)));
-    vec3 T = normalize(vec3(model * vec4(tangent, 0.0)));
+    vec3 N = normalize(vec3(world * vec4(normal, 0.0)));
+    vec3 T = normalize(vec3(world * vec4(tangent, 0.0)));
 
     vec3 B = normalize(cross(N, T));
     mat3 TBN = mat3(T, B, N);
     // We can transpose here instead of inversing because TBN is orthogonal => TBN^T == TBN^(-1)
     mat3 TBN_inv = transpose(TBN);
 
-    vec3 viewPos = (inverse(view) * -1.0 * view * model * vec4(position, 0.0)).xyz;
+    vec3 viewPos = (inverse(view) * -1.0 * view * world * vec4(position, 0.0)).xyz;
 
-    tangentFragPos = TBN_inv * (model * vec4(position, 1.0)).xyz;
+    tangentFragPos = TBN_inv * (world * vec4(position, 1.0)).xyz;
     texCoords = aTexCoords;
     tangentLightPos = TBN_inv * lightPos;
     tangentViewPos = TBN_inv * viewPos;
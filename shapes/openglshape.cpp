@@ -54,3 +54,34 @@ void OpenGLShape::draw() {
         m_VAO->unbind();
     }
 }
+
+/**
+ * @param transforms - Model matrix of every instance. Shaders read it from ShaderAttrib::INSTANCE_MODEL.
+ */
+void OpenGLShape::setInstanceData(const std::vector<glm::mat4> &transforms) {
+    if (m_VAO) {
+        m_VAO->setInstanceTransforms(reinterpret_cast<const GLfloat *>(transforms.data()), transforms.size());
+    }
+}
+
+/**
+ * @param data - Records of per-instance attributes.
+ * @param count - Number of records.
+ * @param stride - Size of a record in bytes.
+ * @param markers - Where the attributes are in a record.
+ * @param instancesPerRecord - Number of instances drawn with the same record.
+ */
+void OpenGLShape::setInstanceData(const void *data, int count, int stride, const std::vector<VBOAttribMarker> &markers,
+                                  int instancesPerRecord) {
+    if (m_VAO) {
+        m_VAO->setInstanceData(data, count, stride, markers, instancesPerRecord);
+    }
+}
+
+void OpenGLShape::drawInstanced() {
+    if (m_VAO) {
+        m_VAO->bind();
+        m_VAO->drawInstanced();
+        m_VAO->unbind();
+    }
+}
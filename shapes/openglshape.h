@@ -2,6 +2,9 @@
 #define OPENGLSHAPE_H
 
 #include <memory>
+#include <vector>
+
+#include "glm/glm.hpp"
 
 #include "gl/datatype/vbo.h"
 #include "gl/datatype/vboattribmarker.h"
@@ -33,6 +36,19 @@ public:
     /** Draw the initialized geometry. */
     void draw();
 
+    /** Replaces the model matrices of the instances drawInstanced() draws. Call after buildVAO(). */
+    void setInstanceData(const std::vector<glm::mat4> &transforms);
+
+    /**
+     * Replaces the per-instance data of drawInstanced() with records laid out as the markers say,
+     * each drawn by instancesPerRecord instances. Call after buildVAO().
+     */
+    void setInstanceData(const void *data, int count, int stride, const std::vector<VBOAttribMarker> &markers,
+                         int instancesPerRecord);
+
+    /** Draw the initialized geometry once per instance, in one draw call. */
+    void drawInstanced();
+
 private:
     GLfloat *m_data;                            /// vector of floats containing the vertex data.
     GLsizeiptr m_size;                          /// size of the data array, in bytes.
@@ -0,0 +1,108 @@
+# -------------------------------------------------
+# Everything but the main window, shared by the application (final.pro) and the benchmarks
+# (benchmarks/benchmarks.pro)
+# -------------------------------------------------
+QT += opengl xml
+
+unix:!macx {
+    LIBS += -lGLU
+}
+win32 {
+    DEFINES += GLEW_STATIC
+    LIBS += -lopengl32 -lglu32
+}
+
+SOURCES += \
+    $$PWD/LSystem/LSystem.cpp \
+    $$PWD/LSystem/RuleTable.cpp \
+    $$PWD/LSystem/SymbolStream.cpp \
+    $$PWD/LSystem/SequenceDag.cpp \
+    $$PWD/LSystem/ParametricLSystem.cpp \
+    $$PWD/LSystem/ContextIndex.cpp \
+    $$PWD/LSystem/PackedSequence.cpp \
+    $$PWD/lib/Utilities.cpp \
+    $$PWD/glew-1.10.0/src/glew.c \
+    $$PWD/glwidget.cpp \
+    $$PWD/shapes/BarrelComponent.cpp \
+    $$PWD/shapes/CircleComponent.cpp \
+    $$PWD/shapes/Cone.cpp \
+    $$PWD/shapes/ConeComponent.cpp \
+    $$PWD/shapes/Cylinder.cpp \
+    $$PWD/shapes/Island.cpp \
+    $$PWD/shapes/Leaf.cpp \
+    $$PWD/shapes/RoundedCylinder.cpp \
+    $$PWD/shapes/Shape.cpp \
+    $$PWD/shapes/ShapeComponent.cpp \
+    $$PWD/shapes/Sphere.cpp \
+    $$PWD/shapes/SphereComponent.cpp \
+    $$PWD/shapes/triangle.cpp \
+    $$PWD/tree/Tree.cpp \
+    $$PWD/tree/TurtleProgram.cpp \
+    $$PWD/tree/InstanceBatch.cpp \
+    $$PWD/tree/TreeBuilder.cpp \
+    $$PWD/ui/Databinding.cpp \
+    $$PWD/ui/Settings.cpp \
+    $$PWD/uniforms/uniformvariable.cpp \
+    $$PWD/uniforms/uniformcache.cpp \
+    $$PWD/uniforms/uniformwidget.cpp \
+    $$PWD/camera/orbitingcamera.cpp \
+    $$PWD/uniforms/varsfile.cpp \
+    $$PWD/lib/resourceloader.cpp \
+    $$PWD/gl/datatype/vbo.cpp \
+    $$PWD/gl/datatype/vboattribmarker.cpp \
+    $$PWD/shapes/openglshape.cpp \
+    $$PWD/gl/datatype/vao.cpp
+
+HEADERS += \
+    $$PWD/LSystem/LSystem.h \
+    $$PWD/LSystem/RuleTable.h \
+    $$PWD/LSystem/SymbolStream.h \
+    $$PWD/LSystem/SequenceDag.h \
+    $$PWD/LSystem/ParametricLSystem.h \
+    $$PWD/LSystem/ContextIndex.h \
+    $$PWD/LSystem/PackedSequence.h \
+    $$PWD/lib/Utilities.h \
+    $$PWD/lib/CounterRandom.h \
+    $$PWD/shapes/BarrelComponent.h \
+    $$PWD/shapes/CircleComponent.h \
+    $$PWD/shapes/Cone.h \
+    $$PWD/shapes/ConeComponent.h \
+    $$PWD/shapes/Cylinder.h \
+    $$PWD/shapes/Island.h \
+    $$PWD/shapes/Leaf.h \
+    $$PWD/shapes/RoundedCylinder.h \
+    $$PWD/shapes/Shape.h \
+    $$PWD/shapes/ShapeComponent.h \
+    $$PWD/shapes/Sphere.h \
+    $$PWD/shapes/SphereComponent.h \
+    $$PWD/shapes/triangle.h \
+    $$PWD/tree/Tree.h \
+    $$PWD/tree/TurtleProgram.h \
+    $$PWD/tree/InstanceBatch.h \
+    $$PWD/tree/TreeBuilder.h \
+    $$PWD/ui/Databinding.h \
+    $$PWD/ui/Settings.h \
+    $$PWD/glew-1.10.0/include/GL/glew.h \
+    $$PWD/glwidget.h \
+    $$PWD/uniforms/uniformvariable.h \
+    $$PWD/uniforms/uniformcache.h \
+    $$PWD/lib/common.h \
+    $$PWD/uniforms/uniformwidget.h \
+    $$PWD/camera/orbitingcamera.h \
+    $$PWD/camera/camera.h \
+    $$PWD/uniforms/varsfile.h \
+    $$PWD/shapes/cube.h \
+    $$PWD/lib/resourceloader.h \
+    $$PWD/shapes/sphere.h \
+    $$PWD/shapes/openglshape.h \
+    $$PWD/gl/datatype/vbo.h \
+    $$PWD/gl/datatype/vboattribmarker.h \
+    $$PWD/gl/shaders/shaderattriblocations.h \
+    $$PWD/gl/datatype/vao.h
+
+INCLUDEPATH += $$PWD $$PWD/glm $$PWD/ui $$PWD/glew-1.10.0/include
+DEPENDPATH += $$PWD/glm $$PWD/ui $$PWD/glew-1.10.0/include
+
+DEFINES += _USE_MATH_DEFINES
+DEFINES += TIXML_USE_STL
+DEFINES += GLM_SWIZZLE GLM_FORCE_RADIANS
@@ -0,0 +1,392 @@
+#include "InstanceBatch.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define INSTANCEBATCH_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// The AVX kernel is compiled for AVX on its own, so the rest of the build needs no extra flags and
+// still runs on CPUs without it.
+#if defined(__GNUC__)
+#define TARGET_AVX __attribute__((target("avx")))
+#else
+#define TARGET_AVX
+#endif
+
+namespace {
+
+#ifdef INSTANCEBATCH_X86
+// Whether the CPU and the OS support AVX.
+bool detectAvx() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && (_xgetbv(0) & 6) == 6;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+#endif
+}
+#endif
+
+}
+
+InstanceBatch::InstanceBatch() :
+    m_size(0)
+{
+
+}
+
+/**
+ * Removes all instances, keeping the allocated memory.
+ * @brief InstanceBatch::clear
+ */
+void InstanceBatch::clear() {
+    m_blocks.clear();
+    m_size = 0;
+}
+
+/**
+ * @brief InstanceBatch::reserve
+ * @param count number of instances to reserve memory for
+ */
+void InstanceBatch::reserve(size_t count) {
+    m_blocks.reserve((count + BLOCK_SIZE - 1) / BLOCK_SIZE);
+}
+
+/**
+ * Adds an instance.
+ * @brief InstanceBatch::add
+ * @param basis index of the basis in the bases passed to emit()
+ */
+void InstanceBatch::add(const glm::vec3 &position, const glm::quat &orientation, const glm::vec3 &scale, uint32_t basis) {
+    size_t lane = m_size % BLOCK_SIZE;
+    if (lane == 0) {
+        m_blocks.push_back(Block());
+    }
+    Block &block = m_blocks.back();
+    for (int i = 0; i < 3; i++) {
+        block.position[i][lane] = position[i];
+        block.scale[i][lane] = scale[i];
+    }
+    block.orientation[0][lane] = orientation.x;
+    block.orientation[1][lane] = orientation.y;
+    block.orientation[2][lane] = orientation.z;
+    block.orientation[3][lane] = orientation.w;
+    block.basis[lane] = basis;
+    m_size++;
+}
+
+/**
+ * Adds all instances of another batch after the ones in this one.
+ * @brief InstanceBatch::append
+ */
+void InstanceBatch::append(const InstanceBatch &other) {
+    if (m_size % BLOCK_SIZE == 0) {
+        // Whole blocks line up, the unused lanes of the last one are overwritten by the next add()
+        m_blocks.insert(m_blocks.end(), other.m_blocks.begin(), other.m_blocks.end());
+        m_size += other.m_size;
+        return;
+    }
+    for (size_t i = 0; i < other.m_size; i++) {
+        const Block &block = other.m_blocks[i / BLOCK_SIZE];
+        size_t lane = i % BLOCK_SIZE;
+        add(glm::vec3(block.position[0][lane], block.position[1][lane], block.position[2][lane]),
+            glm::quat(block.orientation[3][lane], block.orientation[0][lane], block.orientation[1][lane], block.orientation[2][lane]),
+            glm::vec3(block.scale[0][lane], block.scale[1][lane], block.scale[2][lane]),
+            block.basis[lane]);
+    }
+}
+
+/**
+ * Reads back the position, orientation and basis instance i was added with.
+ * @brief InstanceBatch::get
+ */
+void InstanceBatch::get(size_t i, glm::vec3 &position, glm::quat &orientation, uint32_t &basis) const {
+    const Block &block = m_blocks[i / BLOCK_SIZE];
+    size_t lane = i % BLOCK_SIZE;
+    position = glm::vec3(block.position[0][lane], block.position[1][lane], block.position[2][lane]);
+    orientation = glm::quat(block.orientation[3][lane], block.orientation[0][lane], block.orientation[1][lane], block.orientation[2][lane]);
+    basis = block.basis[lane];
+}
+
+/**
+ * Writes the transforms of instances [begin, end) to out[begin] to out[end - 1]. All kernels do
+ * the same operations in the same order, so they give the same transforms. An unsupported kernel
+ * falls back to the scalar one.
+ * @brief InstanceBatch::emit
+ * @param bases transforms the instances refer to by index
+ * @param out transforms of the whole batch
+ * @param kernel kernel to emit with
+ */
+void InstanceBatch::emit(const std::vector<glm::mat4> &bases, size_t begin, size_t end, glm::mat4 *out, InstanceKernel kernel) const {
+    if (!isSupported(kernel)) {
+        kernel = KERNEL_SCALAR;
+    }
+    switch (kernel) {
+        case KERNEL_AVX:
+            emitAvx(bases, begin, end, out);
+            break;
+        case KERNEL_SSE:
+            emitSse(bases, begin, end, out);
+            break;
+        default:
+            emitScalar(bases, begin, end, out);
+            break;
+    }
+}
+
+/**
+ * @brief InstanceBatch::isSupported
+ * @return whether the kernel can run on this CPU
+ */
+bool InstanceBatch::isSupported(InstanceKernel kernel) {
+    switch (kernel) {
+        case KERNEL_SCALAR:
+            return true;
+#ifdef INSTANCEBATCH_X86
+        case KERNEL_SSE:
+            return true;
+        case KERNEL_AVX: {
+            static const bool avx = detectAvx();
+            return avx;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief InstanceBatch::bestKernel
+ * @return the widest kernel this CPU supports
+ */
+InstanceKernel InstanceBatch::bestKernel() {
+    if (isSupported(KERNEL_AVX)) {
+        return KERNEL_AVX;
+    }
+    if (isSupported(KERNEL_SSE)) {
+        return KERNEL_SSE;
+    }
+    return KERNEL_SCALAR;
+}
+
+const char *InstanceBatch::kernelName(InstanceKernel kernel) {
+    switch (kernel) {
+        case KERNEL_AVX:
+            return "AVX";
+        case KERNEL_SSE:
+            return "SSE";
+        default:
+            return "scalar";
+    }
+}
+
+/**
+ * Reference kernel, one instance at a time with glm.
+ * @brief InstanceBatch::emitScalar
+ */
+void InstanceBatch::emitScalar(const std::vector<glm::mat4> &bases, size_t begin, size_t end, glm::mat4 *out) const {
+    for (size_t i = begin; i < end; i++) {
+        emitOne(bases, i, out);
+    }
+}
+
+/**
+ * @brief InstanceBatch::emitOne
+ * @param i instance to write the transform of to out[i]
+ */
+void InstanceBatch::emitOne(const std::vector<glm::mat4> &bases, size_t i, glm::mat4 *out) const {
+    const Block &block = m_blocks[i / BLOCK_SIZE];
+    size_t lane = i % BLOCK_SIZE;
+    glm::quat orientation(block.orientation[3][lane], block.orientation[0][lane], block.orientation[1][lane], block.orientation[2][lane]);
+    glm::mat4 placement = glm::mat4_cast(glm::normalize(orientation));
+    placement[0] *= block.scale[0][lane];
+    placement[1] *= block.scale[1][lane];
+    placement[2] *= block.scale[2][lane];
+    placement[3] = glm::vec4(block.position[0][lane], block.position[1][lane], block.position[2][lane], 1.f);
+    out[i] = placement * bases[block.basis[lane]];
+}
+
+#ifdef INSTANCEBATCH_X86
+
+/**
+ * Builds the placements of four instances at a time from the fields of half a block, transposes
+ * them to one column per register, and multiplies each by its basis.
+ * @brief InstanceBatch::emitSse
+ */
+void InstanceBatch::emitSse(const std::vector<glm::mat4> &bases, size_t begin, size_t end, glm::mat4 *out) const {
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 two = _mm_set1_ps(2.f);
+    size_t i = begin;
+    for (; i < end && i % 4 != 0; i++) {
+        emitOne(bases, i, out);
+    }
+    for (; i + 4 <= end; i += 4) {
+        const Block &block = m_blocks[i / BLOCK_SIZE];
+        size_t lane = i % BLOCK_SIZE;
+        __m128 x = _mm_loadu_ps(&block.orientation[0][lane]);
+        __m128 y = _mm_loadu_ps(&block.orientation[1][lane]);
+        __m128 z = _mm_loadu_ps(&block.orientation[2][lane]);
+        __m128 w = _mm_loadu_ps(&block.orientation[3][lane]);
+        // Summed in the same order as glm::dot
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))));
+        __m128 inverse = _mm_div_ps(one, length);
+        x = _mm_mul_ps(x, inverse);
+        y = _mm_mul_ps(y, inverse);
+        z = _mm_mul_ps(z, inverse);
+        w = _mm_mul_ps(w, inverse);
+
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xz = _mm_mul_ps(x, z), xy = _mm_mul_ps(x, y), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        __m128 sx = _mm_loadu_ps(&block.scale[0][lane]);
+        __m128 sy = _mm_loadu_ps(&block.scale[1][lane]);
+        __m128 sz = _mm_loadu_ps(&block.scale[2][lane]);
+        __m128 c0x = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        __m128 c0y = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        __m128 c0z = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+        __m128 c0w = _mm_setzero_ps();
+        __m128 c1x = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        __m128 c1y = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        __m128 c1z = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+        __m128 c1w = _mm_setzero_ps();
+        __m128 c2x = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        __m128 c2y = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        __m128 c2z = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+        __m128 c2w = _mm_setzero_ps();
+        __m128 c3x = _mm_loadu_ps(&block.position[0][lane]);
+        __m128 c3y = _mm_loadu_ps(&block.position[1][lane]);
+        __m128 c3z = _mm_loadu_ps(&block.position[2][lane]);
+        __m128 c3w = one;
+        _MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+        _MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+        _MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+        _MM_TRANSPOSE4_PS(c3x, c3y, c3z, c3w);
+        // After the transposes, column c of instance l is in the l-th register of column c
+        const __m128 columns[4][4] = {
+            { c0x, c1x, c2x, c3x },
+            { c0y, c1y, c2y, c3y },
+            { c0z, c1z, c2z, c3z },
+            { c0w, c1w, c2w, c3w },
+        };
+
+        for (int l = 0; l < 4; l++) {
+            const __m128 *a = columns[l];
+            const float *k = &bases[block.basis[lane + l]][0][0];
+            float *o = &out[i + l][0][0];
+            for (int j = 0; j < 4; j++) {
+                __m128 m = _mm_mul_ps(a[0], _mm_set1_ps(k[4 * j]));
+                m = _mm_add_ps(m, _mm_mul_ps(a[1], _mm_set1_ps(k[4 * j + 1])));
+                m = _mm_add_ps(m, _mm_mul_ps(a[2], _mm_set1_ps(k[4 * j + 2])));
+                m = _mm_add_ps(m, _mm_mul_ps(a[3], _mm_set1_ps(k[4 * j + 3])));
+                _mm_storeu_ps(o + 4 * j, m);
+            }
+        }
+    }
+    emitScalar(bases, i, end, out);
+}
+
+/**
+ * Same as emitSse(), a whole block at a time, multiplying by the basis two columns at a time.
+ * @brief InstanceBatch::emitAvx
+ */
+TARGET_AVX
+void InstanceBatch::emitAvx(const std::vector<glm::mat4> &bases, size_t begin, size_t end, glm::mat4 *out) const {
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 two = _mm256_set1_ps(2.f);
+    size_t i = begin;
+    for (; i < end && i % BLOCK_SIZE != 0; i++) {
+        emitOne(bases, i, out);
+    }
+    for (; i + BLOCK_SIZE <= end; i += BLOCK_SIZE) {
+        const Block &block = m_blocks[i / BLOCK_SIZE];
+        __m256 x = _mm256_loadu_ps(&block.orientation[0][0]);
+        __m256 y = _mm256_loadu_ps(&block.orientation[1][0]);
+        __m256 z = _mm256_loadu_ps(&block.orientation[2][0]);
+        __m256 w = _mm256_loadu_ps(&block.orientation[3][0]);
+        __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_add_ps(_mm256_mul_ps(z, z), _mm256_mul_ps(w, w))));
+        __m256 inverse = _mm256_div_ps(one, length);
+        x = _mm256_mul_ps(x, inverse);
+        y = _mm256_mul_ps(y, inverse);
+        z = _mm256_mul_ps(z, inverse);
+        w = _mm256_mul_ps(w, inverse);
+
+        __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+        __m256 xz = _mm256_mul_ps(x, z), xy = _mm256_mul_ps(x, y), yz = _mm256_mul_ps(y, z);
+        __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+        __m256 sx = _mm256_loadu_ps(&block.scale[0][0]);
+        __m256 sy = _mm256_loadu_ps(&block.scale[1][0]);
+        __m256 sz = _mm256_loadu_ps(&block.scale[2][0]);
+        // Rows x, y, z, w of columns 0 to 3, one instance per lane
+        __m256 rows[4][4] = {
+            { _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx),
+              _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy),
+              _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz),
+              _mm256_loadu_ps(&block.position[0][0]) },
+            { _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx),
+              _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy),
+              _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz),
+              _mm256_loadu_ps(&block.position[1][0]) },
+            { _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx),
+              _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy),
+              _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz),
+              _mm256_loadu_ps(&block.position[2][0]) },
+            { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), one },
+        };
+
+        // Transpose each half to one column per register: columns[l][c] is column c of instance l
+        __m128 columns[8][4];
+        for (int c = 0; c < 4; c++) {
+            for (int half = 0; half < 2; half++) {
+                __m128 cx = half ? _mm256_extractf128_ps(rows[0][c], 1) : _mm256_castps256_ps128(rows[0][c]);
+                __m128 cy = half ? _mm256_extractf128_ps(rows[1][c], 1) : _mm256_castps256_ps128(rows[1][c]);
+                __m128 cz = half ? _mm256_extractf128_ps(rows[2][c], 1) : _mm256_castps256_ps128(rows[2][c]);
+                __m128 cw = half ? _mm256_extractf128_ps(rows[3][c], 1) : _mm256_castps256_ps128(rows[3][c]);
+                _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+                columns[half * 4][c] = cx;
+                columns[half * 4 + 1][c] = cy;
+                columns[half * 4 + 2][c] = cz;
+                columns[half * 4 + 3][c] = cw;
+            }
+        }
+
+        for (int l = 0; l < 8; l++) {
+            __m256 a[4];
+            for (int c = 0; c < 4; c++) {
+                a[c] = _mm256_insertf128_ps(_mm256_castps128_ps256(columns[l][c]), columns[l][c], 1);
+            }
+            const float *k = &bases[block.basis[l]][0][0];
+            float *o = &out[i + l][0][0];
+            for (int j = 0; j < 4; j += 2) {
+                // Columns j and j + 1 of the basis, one per half
+                __m256 kk = _mm256_loadu_ps(k + 4 * j);
+                __m256 m = _mm256_mul_ps(a[0], _mm256_permute_ps(kk, 0x00));
+                m = _mm256_add_ps(m, _mm256_mul_ps(a[1], _mm256_permute_ps(kk, 0x55)));
+                m = _mm256_add_ps(m, _mm256_mul_ps(a[2], _mm256_permute_ps(kk, 0xAA)));
+                m = _mm256_add_ps(m, _mm256_mul_ps(a[3], _mm256_permute_ps(kk, 0xFF)));
+                _mm256_storeu_ps(o + 4 * j, m);
+            }
+        }
+    }
+    emitScalar(bases, i, end, out);
+}
+
+#else
+
+void InstanceBatch::emitSse(const std::vector<glm::mat4> &bases, size_t begin, size_t end, glm::mat4 *out) const {
+    emitScalar(bases, begin, end, out);
+}
+
+void InstanceBatch::emitAvx(const std::vector<glm::mat4> &bases, size_t begin, size_t end, glm::mat4 *out) const {
+    emitScalar(bases, begin, end, out);
+}
+
+#endif
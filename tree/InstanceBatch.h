@@ -0,0 +1,63 @@
+#ifndef INSTANCEBATCH_H
+#define INSTANCEBATCH_H
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+enum InstanceKernel {
+    KERNEL_SCALAR,
+    KERNEL_SSE,
+    KERNEL_AVX
+};
+
+/**
+ * Instances waiting to be turned into transforms, stored as blocks of eight instances with one
+ * array per field so several can be emitted at once with SIMD. Instance i becomes
+ *     [ R(orientation) * diag(scale) | position ] * bases[basis]
+ * where the bases are the transforms many instances share (the model matrix, the placement of a
+ * leaf on its branch, ...). An all-zero basis gives an all-zero transform.
+ *
+ * Orientations do not need to be unit length, but must not be zero; they are normalized when
+ * emitted.
+ */
+class InstanceBatch
+{
+public:
+    InstanceBatch();
+
+    void clear();
+    void reserve(size_t count);
+    void add(const glm::vec3 &position, const glm::quat &orientation, const glm::vec3 &scale, uint32_t basis);
+    void append(const InstanceBatch &other);
+    void get(size_t i, glm::vec3 &position, glm::quat &orientation, uint32_t &basis) const;
+    size_t size() const { return m_size; }
+
+    void emit(const std::vector<glm::mat4> &bases, size_t begin, size_t end, glm::mat4 *out, InstanceKernel kernel) const;
+
+    static bool isSupported(InstanceKernel kernel);
+    static InstanceKernel bestKernel();
+    static const char *kernelName(InstanceKernel kernel);
+
+private:
+    void emitScalar(const std::vector<glm::mat4> &bases, size_t begin, size_t end, glm::mat4 *out) const;
+    void emitSse(const std::vector<glm::mat4> &bases, size_t begin, size_t end, glm::mat4 *out) const;
+    void emitAvx(const std::vector<glm::mat4> &bases, size_t begin, size_t end, glm::mat4 *out) const;
+
+    static const size_t BLOCK_SIZE = 8;
+
+    struct Block {
+        float position[3][BLOCK_SIZE];
+        float orientation[4][BLOCK_SIZE]; // x, y, z, w
+        float scale[3][BLOCK_SIZE];
+        uint32_t basis[BLOCK_SIZE];
+    };
+
+    void emitOne(const std::vector<glm::mat4> &bases, size_t i, glm::mat4 *out) const;
+
+    std::vector<Block> m_blocks;
+    size_t m_size;
+};
+
+#endif // INSTANCEBATCH_H
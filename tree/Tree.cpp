@@ -3,11 +3,13 @@
 #include "glm/ext.hpp"
 #include "LSystem/LSystem.h"
 #include "Settings.h"
-#include "time.h"
-#include <random>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 const float Tree::BRANCH_LENGTH = 1.f;
 const glm::vec3 Tree::SCALE_FACTOR = glm::vec3(.6f, .8f, .6f);
+const glm::vec3 Tree::INIT_SCALE_FACTOR = glm::vec3(0.05f, 0.2f, 0.05f);
 // the .5f below is totally arbitrary, I'm not sure why it works
 const glm::vec3 Tree::TRANSLATE = glm::vec3(0, Tree::BRANCH_LENGTH * .5f, 0);
 const std::vector<glm::vec3> Tree::ROTATE_AXES = {
@@ -17,234 +19,971 @@ const std::vector<glm::vec3> Tree::ROTATE_AXES = {
     glm::vec3(0,0,-1.f),
     glm::vec3(.5f,0,.5f),
 };
+// Axes of the turtle's own frame, for the 3D turtle symbols. The turtle heads along +y.
+const std::vector<glm::vec3> Tree::LOCAL_AXES = {
+    glm::vec3(1.f,0,0), // pitch: & and ^
+    glm::vec3(0,1.f,0), // roll: \ and /
+    glm::vec3(0,0,1.f), // yaw: |
+};
+// Random stream for angle jitter, kept clear of the per-generation streams used by the LSystem.
+const uint32_t Tree::ANGLE_STREAM = 0x80000000u;
+// Angle jitter is a whole number of degrees from 0 up to this.
+const int Tree::ANGLE_JITTER_DEGREES = 5;
+// Shorter programs are not worth the cost of starting threads.
+const size_t Tree::PARALLEL_MIN_OPS = 1 << 15;
+// Subtrees differ a lot in size, so each thread gets several to even out the work.
+const int Tree::CHUNKS_PER_THREAD = 4;
+// Number of modules or ops between checks for a cancelled build.
+const size_t Tree::CANCEL_CHECK_INTERVAL = 1 << 14;
+const uint64_t TurtleOutput::NO_SEGMENT;
 
 Tree::Tree():
-    m_lsystem()
+    m_settings(settings),
+    m_cancel(nullptr),
+    m_lsystem(),
+    m_dirty(ALL_STAGES),
+    m_generation(0),
+    m_leafData(std::make_shared<std::vector<glm::mat4>>()),
+    m_branchData(std::make_shared<Branch>()),
+    m_skeleton(std::make_shared<Skeleton>()),
+    m_leafTips(std::make_shared<std::vector<LeafTip>>()),
+    m_leafMatrices(true),
+    m_leafScale(0.f),
+    m_is2D(false),
+    m_isParametric(false)
 {
-    m_branchData.body.reserve(settings.recursions * 2);
-    m_branchData.tip.reserve(settings.recursions);
-    m_leafData.reserve(settings.recursions * 2);
+    setThreadCount(0);
+    m_kernel = InstanceBatch::bestKernel();
+    m_branchData->body.reserve(settings.recursions * 2);
+    m_branchData->tip.reserve(settings.recursions);
+    m_leafData->reserve(settings.recursions * 2);
 }
 
 Tree::~Tree() {
 
 }
 
+namespace {
+
+// One module handed to the turtle: a symbol and the parameters it carries, if any.
+struct TurtleModule {
+    char symbol;
+    const float *params;
+    int paramCount;
+    uint32_t count; // number of consecutive forward moves collapsed into this module
+};
+
+// Lookup table of the symbols that move the turtle forward.
+class ForwardSet {
+public:
+    explicit ForwardSet(const std::vector<char> &symbols) {
+        std::fill(m_contains, m_contains + 256, false);
+        for (char c : symbols) {
+            m_contains[static_cast<unsigned char>(c)] = true;
+        }
+    }
+    bool contains(char symbol) const { return m_contains[static_cast<unsigned char>(symbol)]; }
+private:
+    bool m_contains[256];
+};
+
+// Feeds the turtle from the streamed expansion of a plain L-system. Runs of forward symbols
+// (e.g. from F -> F or F -> FF) are handed over as one module with a count, since all but the
+// first move of a run only extend the same branch.
+class StreamSource {
+public:
+    StreamSource(const SymbolStream &symbols, const std::vector<char> &forwardSymbols) :
+        m_symbols(symbols), m_forward(forwardSymbols) {}
+    bool next(TurtleModule &module) {
+        module.params = nullptr;
+        module.paramCount = 0;
+        module.count = 1;
+        if (!m_symbols.next(module.symbol)) {
+            return false;
+        }
+        if (m_forward.contains(module.symbol)) {
+            char c;
+            while (m_symbols.peek(c) && m_forward.contains(c)) {
+                m_symbols.next(c);
+                module.count++;
+            }
+        }
+        return true;
+    }
+    bool peek(char &symbol) { return m_symbols.peek(symbol); }
+    bool isForward(char symbol) const { return m_forward.contains(symbol); }
+private:
+    SymbolStream m_symbols;
+    ForwardSet m_forward;
+};
+
+// Feeds the turtle from an expanded parametric module string. Forward modules carry their own
+// step length, so they are not collapsed.
+class ModuleSource {
+public:
+    ModuleSource(const ModuleString &modules, const std::vector<char> &forwardSymbols) :
+        m_modules(modules), m_forward(forwardSymbols), m_index(0) {}
+    bool next(TurtleModule &module) {
+        if (m_index >= m_modules.size()) {
+            return false;
+        }
+        module.symbol = m_modules.symbols[m_index];
+        module.params = m_modules.paramsOf(m_index);
+        module.paramCount = m_modules.paramCount(m_index);
+        module.count = 1;
+        m_index++;
+        return true;
+    }
+    bool peek(char &symbol) {
+        if (m_index >= m_modules.size()) {
+            return false;
+        }
+        symbol = m_modules.symbols[m_index];
+        return true;
+    }
+    bool isForward(char symbol) const { return m_forward.contains(symbol); }
+private:
+    const ModuleString &m_modules;
+    ForwardSet m_forward;
+    size_t m_index;
+};
+
+// Indices of the transforms from Tree::getInstanceBases(). The side leaves follow BASIS_LEAF.
+enum InstanceBasis : uint32_t {
+    BASIS_ZERO,
+    BASIS_BRANCH,
+    BASIS_CONE,
+    BASIS_LEAF
+};
+
+// Part of a turtle program: bracketed subtrees right after each other, which all run from the
+// state at the first PUSH, or the ops between them, which run in order in the first pass.
+struct TurtlePiece {
+    TurtlePiece(size_t begin, size_t end, bool subtree) : begin(begin), end(end), subtree(subtree) {}
+    size_t begin;
+    size_t end;
+    bool subtree;
+    LState entry;
+    TurtleOutput output;
+};
+
+// Joins the skeleton segments the parts of a run recorded, given in program order, into one
+// skeleton. Since a parent always comes before its children, the depths follow in one pass
+// forward and the subtrees in one pass back, over the segments rather than the program.
+void joinSkeleton(const std::vector<const TurtleOutput *> &parts, Skeleton &skeleton) {
+    std::vector<uint32_t> segmentOffsets(parts.size());
+    std::vector<uint32_t> leafOffsets(parts.size());
+    size_t segments = 0, leaves = 0;
+    for (size_t p = 0; p < parts.size(); p++) {
+        segmentOffsets[p] = segments;
+        leafOffsets[p] = leaves;
+        segments += parts[p]->segmentParents.size();
+        leaves += parts[p]->leaf.size();
+    }
+    auto indexOf = [&](uint64_t segment) -> int32_t {
+        if (segment == TurtleOutput::NO_SEGMENT) {
+            return -1;
+        }
+        return segmentOffsets[segment >> 32] + static_cast<uint32_t>(segment);
+    };
+
+    skeleton.clear();
+    skeleton.resize(segments);
+    size_t s = 0;
+    for (const TurtleOutput *part : parts) {
+        for (uint64_t parent : part->segmentParents) {
+            skeleton.parent[s++] = indexOf(parent);
+        }
+    }
+    for (size_t p = 0; p < parts.size(); p++) {
+        for (const SegmentEnd &end : parts[p]->segmentEnds) {
+            int32_t i = indexOf(end.segment);
+            skeleton.start[i] = end.start;
+            skeleton.end[i] = end.end;
+            skeleton.radius[i] = end.radius;
+            skeleton.leafBegin[i] = end.leafCount != 0 ? leafOffsets[p] + end.leafBegin : 0;
+            skeleton.leafCount[i] = end.leafCount;
+        }
+    }
+
+    for (size_t i = 0; i < segments; i++) {
+        int32_t parent = skeleton.parent[i];
+        skeleton.depth[i] = parent < 0 ? 0 : skeleton.depth[parent] + 1;
+        skeleton.subtreeEnd[i] = i + 1;
+        glm::vec3 radius = glm::vec3(skeleton.radius[i]);
+        skeleton.subtreeMin[i] = glm::min(skeleton.start[i], skeleton.end[i]) - radius;
+        skeleton.subtreeMax[i] = glm::max(skeleton.start[i], skeleton.end[i]) + radius;
+    }
+    for (size_t i = segments; i-- > 0; ) {
+        int32_t parent = skeleton.parent[i];
+        if (parent >= 0) {
+            skeleton.subtreeEnd[parent] = std::max(skeleton.subtreeEnd[parent], skeleton.subtreeEnd[i]);
+            skeleton.subtreeMin[parent] = glm::min(skeleton.subtreeMin[parent], skeleton.subtreeMin[i]);
+            skeleton.subtreeMax[parent] = glm::max(skeleton.subtreeMax[parent], skeleton.subtreeMax[i]);
+        }
+    }
+}
+
+}
+
 /**
  * @brief Parses an LSystem string and generates transformation matrices for primitives.
  * @param model: The initial model matrix.
  * @return
  */
 void Tree::buildTree(const glm::mat4 &model, const float leafScale) {
+    buildTree(settings, model, leafScale, nullptr);
+}
+
+/**
+ * Builds the tree for a copy of the settings, so it can run on another thread while the settings
+ * change. Only the stages that depend on what changed since the last build are redone (see
+ * TreeStage): a new angle reruns the turtle on the compiled program, and a new leaf size only
+ * rebuilds the leaf transforms. The build stops early once cancel is set, leaving the branch and
+ * leaf data incomplete; the stages it did not finish are redone by the next build.
+ * @brief Tree::buildTree
+ * @param treeSettings settings to build the tree for
+ * @param model the initial model matrix
+ * @param cancel set from another thread to stop the build, or null
+ * @return false if the build was cancelled
+ */
+bool Tree::buildTree(const Settings &treeSettings, const glm::mat4 &model, const float leafScale,
+                     const std::atomic<bool> *cancel) {
+    if (treeSettings.treeOption != m_settings.treeOption || treeSettings.seed != m_settings.seed ||
+            treeSettings.recursions != m_settings.recursions) {
+        m_dirty |= STAGE_PROGRAM;
+    }
+    if (treeSettings.angle != m_settings.angle) {
+        m_dirty |= STAGE_TURTLE;
+    }
+    if (model != m_model) {
+        m_dirty |= STAGE_BRANCHES | STAGE_LEAVES;
+    }
+    if (leafScale != m_leafScale) {
+        m_dirty |= STAGE_LEAVES;
+    }
+    if (m_dirty & STAGE_PROGRAM) {
+        m_dirty |= STAGE_TURTLE;
+    }
+    if (m_dirty & STAGE_TURTLE) {
+        m_dirty |= STAGE_BRANCHES | STAGE_LEAVES;
+    }
+    if (!m_leafMatrices) {
+        m_dirty &= ~STAGE_LEAVES;
+    }
+    m_settings = treeSettings;
+    m_model = model;
     m_leafScale = leafScale;
-    addTreeOptionRule(settings.treeOption);
-    float ANGLE = glm::radians(settings.angle);
-    m_lsystem.setRecursion(settings.recursions);
-    m_lsystem.generateSequence();
-    m_branchData.body.clear();
-    m_branchData.tip.clear();
-    m_leafData.clear();
+    m_cancel = cancel;
+
+    if (m_dirty & STAGE_PROGRAM) {
+        compileTree();
+        if (!isCancelled()) {
+            m_dirty &= ~STAGE_PROGRAM;
+        }
+    }
+    if ((m_dirty & STAGE_TURTLE) && !isCancelled()) {
+        run(m_program);
+        if (!isCancelled()) {
+            m_dirty &= ~STAGE_TURTLE;
+        }
+    }
+    if (!isCancelled()) {
+        emitTree(model, m_dirty & (STAGE_BRANCHES | STAGE_LEAVES));
+        m_dirty &= ~(STAGE_BRANCHES | STAGE_LEAVES);
+    }
+    bool finished = !isCancelled();
+    m_cancel = nullptr;
+    return finished;
+}
+
+/**
+ * Expands the L-system of the current tree option and compiles it into m_program. Clears the
+ * branch and leaf data and reserves them for the new tree.
+ * @brief Tree::compileTree
+ */
+void Tree::compileTree() {
+    addTreeOptionRule(m_settings.treeOption);
+    m_lsystem.setSeed(m_settings.seed);
+    m_random.setSeed(m_settings.seed);
+    m_lsystem.setRecursion(m_settings.recursions);
+    m_parametric.setRecursion(m_settings.recursions);
+    detachOutput(STAGE_BRANCHES | STAGE_LEAVES);
+    m_branchData->body.clear();
+    m_branchData->tip.clear();
+    m_leafData->clear();
+
+    if (m_isParametric) {
+        // Only F draws in a parametric tree; the other rule symbols are just growth points.
+        static const std::vector<char> PARAMETRIC_FORWARD = { 'F' };
+        m_parametric.generateSequence();
+        ModuleSource source(m_parametric.getSequence(), PARAMETRIC_FORWARD);
+        compile(source, m_program);
+        return;
+    }
+    compileSequence();
+}
+
+/**
+ * Compiles the plain L-system into m_program as it expands to the recursions in the settings,
+ * with the branch and leaf data reserved for the tree it makes.
+ * @brief Tree::compileSequence
+ */
+void Tree::compileSequence() {
+    // Every ']' closes a branch with a tip and its leaves, so those can be reserved up front.
+    GrowthPrediction prediction = m_lsystem.predictGrowth(m_settings.recursions);
+    size_t closedBranches = static_cast<size_t>(prediction.count(']'));
+    m_branchData->tip.reserve(closedBranches + 1);
+    m_leafData->reserve(closedBranches * (m_is2D ? 1 : 3));
+
+    // The sequence is compiled as it is generated, so only the opcodes are held in memory.
+    StreamSource source(m_lsystem.stream(), m_lsystem.getRules().symbols());
+    compile(source, m_program);
+}
+
+/**
+ * Compiles a sequence of modules into turtle opcodes. Everything that depends only on the
+ * position in the sequence is resolved here: the rotation axis and angle jitter of every turn,
+ * the axis of the leaves at every ']', and whether a forward move is followed by more of its
+ * branch. Plain symbols use the angle from the settings and a fixed step. In a parametric tree
+ * F(l,w) moves l steps with w times the initial width, and +(a) / -(a) turn by a degrees.
+ * + and - turn about a world axis picked by the branch number. The 3D symbols turn about the
+ * turtle's own axes: & and ^ pitch down and up, \ and / roll left and right, and | turns around.
+ * They take an angle in a parametric tree like + and - do.
+ * Unknown symbols and unmatched ']' are dropped and reported once each. A cancelled build leaves
+ * the program empty.
+ * @brief Tree::compile
+ * @param source module source with next(TurtleModule&), peek(char&) and isForward(char)
+ * @param program program to compile into, cleared first
+ */
+template <typename Source>
+void Tree::compile(Source &source, TurtleProgram &program) {
+    program.clear();
+    bool badSymbols[256] = {};
+    int branchNum = 0;
 
-    std::string string = m_lsystem.getSequence();
+    TurtleModule module;
+    for (size_t modules = 1; source.next(module); modules++) {
+        if (modules % CANCEL_CHECK_INTERVAL == 0 && isCancelled()) {
+            program.clear();
+            return;
+        }
+        char symbol = module.symbol;
+        switch (symbol) {
+            case '-':
+            case '+': {
+                int8_t sign = symbol == '+' ? 1 : -1;
+                uint8_t axis = getRotateAxisIndex(branchNum);
+                if (module.paramCount > 0) {
+                    program.turnBy(axis, sign, module.params[0], false);
+                } else {
+                    program.turn(axis, sign, getAngleJitter(branchNum), false);
+                }
+                break;
+            }
+            case '&':
+            case '^':
+            case '\\':
+            case '/': {
+                int8_t sign = symbol == '&' || symbol == '\\' ? 1 : -1;
+                uint8_t axis = ROTATE_AXES.size() + (symbol == '&' || symbol == '^' ? 0 : 1);
+                if (module.paramCount > 0) {
+                    program.turnBy(axis, sign, module.params[0], true);
+                } else {
+                    program.turn(axis, sign, getAngleJitter(branchNum), true);
+                }
+                break;
+            }
+            case '|':
+                program.turnBy(ROTATE_AXES.size() + 2, 1, 180.f, true);
+                break;
+            case '[':
+                program.push();
+                break;
+            case ']':
+                // The leaves turn on the axis of the last forward move.
+                if (!program.pop(getRotateAxisIndex(std::max(branchNum - 1, 0)))) {
+                    badSymbols[static_cast<unsigned char>(symbol)] = true;
+                }
+                break;
+        default:
+            if (source.isForward(symbol)) {
+                branchNum += module.count;
+                // A branch that goes on after this move is drawn as a cylinder, otherwise as a tip.
+                char nextSymbol;
+                bool continues = module.count > 1 || (source.peek(nextSymbol) && nextSymbol != ']');
+                if (module.paramCount > 0) {
+                    program.forward(module.params[0], module.paramCount > 1 ? module.params[1] : -1.f, continues);
+                } else {
+                    program.forward(module.count, continues);
+                }
+            } else if (!m_isParametric) {
+                // Parametric trees use their other symbols (like A) only as growth points
+                badSymbols[static_cast<unsigned char>(symbol)] = true;
+            }
+            break;
+        }
+    }
+    program.finish();
 
-    std::vector<char> forwardSymbols;
-    forwardSymbols.reserve(m_lsystem.getRules().size());
-    for (auto const& key_val : m_lsystem.getRules()) {
-        forwardSymbols.push_back(key_val.first[0]);
+    for (int c = 0; c < 256; c++) {
+        if (badSymbols[c]) {
+            std::cout << "BAD LSYSTEM SYMBOL: " << static_cast<char>(c) << std::endl;
+        }
     }
+}
 
-    const glm::vec3 INIT_SCALE_FACTOR = glm::vec3(0.05f, 0.2f, 0.05f);
+/**
+ * Runs the turtle over a compiled program. A bracketed subtree only depends on the state at its
+ * PUSH and leaves the state as it found it, so long programs are split into subtrees small
+ * enough to balance across the threads, descending into larger ones. A first pass runs the ops
+ * around those subtrees and records the state each subtree starts from; the subtrees then run
+ * concurrently, each into its own output, and the outputs are joined in program order, which is
+ * the order a single pass emits in. The turtle only records where instances go, into m_output;
+ * emitTree() builds their transforms afterwards. The branch skeleton is recorded in the same pass
+ * and joined into m_skeleton.
+ *
+ * Turns by the settings angle use rotations computed once per run for every axis, direction and
+ * jitter, so a turn is one lookup and one quaternion multiply. World turns apply before the
+ * current orientation, turns about the turtle's own axes after it.
+ * @brief Tree::run
+ * @param program compiled program
+ */
+void Tree::run(const TurtleProgram &program) {
+    float ANGLE = glm::radians(m_settings.angle);
 
-    glm::vec4 origin = glm::vec4(0, 0, 0, 1.f);
-    glm::mat4 identity = glm::mat4();
-    glm::mat4 initScale = glm::scale(identity, INIT_SCALE_FACTOR);
-    glm::mat4 scale = glm::scale(identity, SCALE_FACTOR);
-    glm::vec4 translate = glm::vec4(TRANSLATE, 1.f);
+    // Rotation of a plain turn, by axis (see getTurnAxis), then direction, then degrees of jitter
+    const int jitters = ANGLE_JITTER_DEGREES + 1;
+    const size_t axes = ROTATE_AXES.size() + LOCAL_AXES.size();
+    std::vector<glm::quat> turns(axes * 2 * jitters);
+    for (size_t axis = 0; axis < axes; axis++) {
+        glm::vec3 unitAxis = glm::normalize(getTurnAxis(axis));
+        for (int jitter = 0; jitter < jitters; jitter++) {
+            float newAngle = ANGLE + glm::radians(jitter * 1.f);
+            turns[(axis * 2) * jitters + jitter] = glm::angleAxis(-newAngle, unitAxis);
+            turns[(axis * 2 + 1) * jitters + jitter] = glm::angleAxis(newAngle, unitAxis);
+        }
+    }
+
+    // Split the program into subtrees and the runs of ops around them
+    const std::vector<TurtleOp> &ops = program.ops();
+    const size_t size = ops.size();
+    size_t maxSubtree = m_threads > 1 && size >= PARALLEL_MIN_OPS ? size / (m_threads * CHUNKS_PER_THREAD) : 0;
+    std::vector<TurtlePiece> pieces;
+    size_t begin = 0;
+    for (size_t i = 0; i < size; ) {
+        const TurtleOp &op = ops[i];
+        if (op.opcode == TURTLE_PUSH && op.arg < size && op.arg - i < maxSubtree) {
+            if (begin == i && !pieces.empty() && pieces.back().subtree && op.arg + 1 - pieces.back().begin <= maxSubtree) {
+                // Subtrees right after each other start from the same state, so small ones run as one piece
+                pieces.back().end = op.arg + 1;
+            } else {
+                if (begin < i) {
+                    pieces.emplace_back(begin, i, false);
+                }
+                pieces.emplace_back(i, op.arg + 1, true);
+            }
+            i = op.arg + 1;
+            begin = i;
+        } else {
+            i++;
+        }
+    }
+    if (begin < size || pieces.empty()) {
+        pieces.emplace_back(begin, size, false);
+    }
+    // A single piece records straight into the instances of the last run, otherwise they are joined there
+    m_output.clear();
+    if (pieces.size() == 1) {
+        std::swap(pieces[0].output, m_output);
+    }
+    for (size_t p = 0; p < pieces.size(); p++) {
+        pieces[p].output.part = p;
+    }
 
     LState currState = {
-        glm::translate(identity, -1.f * translate.xyz()), //Needed to avoid overtranslating
-        identity,
-        initScale,
+        -TRANSLATE, //Needed to avoid overtranslating
         0,
-        identity,
-        initScale,
+        glm::quat(),
+        INIT_SCALE_FACTOR,
+        glm::quat(),
+        INIT_SCALE_FACTOR,
+        TurtleOutput::NO_SEGMENT,
     };
     std::vector<LState> prevStates;
-    std::vector<LState> bodyStates; // These are the LStates for the branches that will be cylinders
-                                    // Later, we add a cone cap to them.
+    std::vector<size_t> subtrees;
+    for (size_t p = 0; p < pieces.size(); p++) {
+        TurtlePiece &piece = pieces[p];
+        if (piece.subtree) {
+            piece.entry = currState;
+            subtrees.push_back(p);
+        } else {
+            runRange(program, piece.begin, piece.end, turns, currState, prevStates, piece.output);
+            capBodies(piece.output);
+        }
+    }
 
-    int branchNum = 0;
+    std::atomic<size_t> nextSubtree(0);
+    auto worker = [&]() {
+        for (size_t s = nextSubtree++; s < subtrees.size() && !isCancelled(); s = nextSubtree++) {
+            TurtlePiece &piece = pieces[subtrees[s]];
+            std::vector<LState> stack;
+            runRange(program, piece.begin, piece.end, turns, piece.entry, stack, piece.output);
+            capBodies(piece.output);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(static_cast<size_t>(m_threads), subtrees.size()); t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
 
-    // Parse the string
-    for (size_t i = 0 ; i < string.size() ; i++) {
-        switch (string[i]) {
-            case '-': {
-                //Rotate the current rotation matrix to the left
-                glm::vec3 axis = getRotateAxis(branchNum);
-                float newAngle = getRandomAngle(branchNum, ANGLE);
-                currState.rotate = glm::rotate(-newAngle, axis) * currState.rotate;
-                if (currState.length == 0) {
-                    //Need to update initial state for branch that hasn't been drawn yet
-                    currState.initialRotate = currState.rotate;
+    // A single piece ran straight into m_output, otherwise the pieces are joined there
+    if (pieces.size() == 1) {
+        std::swap(pieces[0].output, m_output);
+    }
+    if (isCancelled()) {
+        return;
+    }
+
+    // Every cylinder gets a cone on top, after all the other tips
+    TurtleOutput &all = m_output;
+    if (pieces.size() > 1) {
+        size_t tips = 0, leaves = 0, bodies = 0;
+        for (const TurtlePiece &piece : pieces) {
+            tips += piece.output.tip.size() + piece.output.cone.size();
+            leaves += piece.output.leaf.size();
+            bodies += piece.output.body.size();
+        }
+        all.tip.reserve(tips + 1);
+        all.leaf.reserve(leaves);
+        all.body.reserve(bodies);
+        for (const TurtlePiece &piece : pieces) {
+            all.tip.append(piece.output.tip);
+            all.leaf.append(piece.output.leaf);
+            all.body.append(piece.output.body);
+        }
+    }
+    for (const TurtlePiece &piece : pieces) {
+        all.tip.append(pieces.size() == 1 ? all.cone : piece.output.cone);
+    }
+    if (currState.length != 0) {
+        addBranch(currState, BASIS_BRANCH, all.tip);
+    }
+
+    std::vector<const TurtleOutput *> parts;
+    for (const TurtlePiece &piece : pieces) {
+        parts.push_back(pieces.size() == 1 ? &all : &piece.output);
+    }
+    endSegment(currState, 0, 0, pieces.size() == 1 ? all : pieces.back().output);
+    detachOutput(STAGE_TURTLE);
+    joinSkeleton(parts, *m_skeleton);
+    collectLeafTips();
+
+    if (prevStates.size() != 0) {
+        std::cout << "Missed " << prevStates.size() << " cached states" << std::endl;
+    }
+}
+
+/**
+ * Turns the instances the last run recorded into transforms, in one batched pass with the SIMD
+ * kernels of InstanceBatch.
+ * @brief Tree::emitTree
+ * @param model the initial model matrix
+ * @param stages STAGE_BRANCHES and STAGE_LEAVES select the transforms to build
+ */
+void Tree::emitTree(const glm::mat4 &model, unsigned stages) {
+    detachOutput(stages);
+    std::vector<glm::mat4> bases = getInstanceBases(model);
+    if (stages & STAGE_BRANCHES) {
+        emitInstances(m_output.tip, bases, m_branchData->tip);
+        emitInstances(m_output.body, bases, m_branchData->body);
+    }
+    if (stages & STAGE_LEAVES) {
+        emitInstances(m_output.leaf, bases, *m_leafData);
+    }
+}
+
+/**
+ * Snapshots share the branch, leaf and skeleton data instead of copying them. Before data that may
+ * be shared is written, the tree swaps it for its own, leaving the snapshots as they were. Every
+ * write to the data goes through here, so this is also where a new generation starts.
+ * @brief Tree::detachOutput
+ * @param stages STAGE_TURTLE, STAGE_BRANCHES and STAGE_LEAVES select the data about to be written
+ */
+void Tree::detachOutput(unsigned stages) {
+    if (stages & (STAGE_TURTLE | STAGE_BRANCHES | STAGE_LEAVES)) {
+        m_generation++;
+    }
+    if ((stages & STAGE_TURTLE) && m_skeleton.use_count() > 1) {
+        m_skeleton = std::make_shared<Skeleton>();
+    }
+    if ((stages & STAGE_TURTLE) && m_leafTips.use_count() > 1) {
+        m_leafTips = std::make_shared<std::vector<LeafTip>>();
+    }
+    if ((stages & STAGE_BRANCHES) && m_branchData.use_count() > 1) {
+        m_branchData = std::make_shared<Branch>();
+    }
+    if ((stages & STAGE_LEAVES) && m_leafData.use_count() > 1) {
+        m_leafData = std::make_shared<std::vector<glm::mat4>>();
+    }
+}
+
+/**
+ * Runs the turtle over ops [begin, end) of a program, recording the instances it emits.
+ * @brief Tree::runRange
+ * @param turns rotations of plain turns, as set up by run()
+ * @param state turtle state to start from, left at the state after the range
+ * @param prevStates saved states of the open branches, left with those still open after the range
+ * @param output receives the instances of the range
+ */
+void Tree::runRange(const TurtleProgram &program, size_t begin, size_t end, const std::vector<glm::quat> &turns,
+                    LState &state, std::vector<LState> &prevStates, TurtleOutput &output) {
+    const int jitters = ANGLE_JITTER_DEGREES + 1;
+    const bool scaleBranches = !m_isParametric;
+    LState currState = state;
+
+    const std::vector<TurtleOp> &ops = program.ops();
+    for (size_t i = begin; i < end; i++) {
+        if ((i - begin) % CANCEL_CHECK_INTERVAL == CANCEL_CHECK_INTERVAL - 1 && isCancelled()) {
+            break;
+        }
+        const TurtleOp &op = ops[i];
+        switch (op.opcode) {
+            case TURTLE_TURN: {
+                //Rotate the current orientation to the left (-1) or right (+1)
+                glm::quat turn;
+                if (op.flags & TurtleProgram::FLAG_VALUES) {
+                    float newAngle = glm::radians(*program.values(op));
+                    turn = glm::angleAxis(op.sign * newAngle, glm::normalize(getTurnAxis(op.axis)));
+                } else {
+                    int direction = op.sign > 0 ? 1 : 0;
+                    turn = turns[(op.axis * 2 + direction) * jitters + op.arg];
+                }
+                if (op.flags & TurtleProgram::FLAG_LOCAL) {
+                    currState.orientation = currState.orientation * turn;
+                } else {
+                    currState.orientation = turn * currState.orientation;
                 }
-                break;
-            }
-            case '+': {
-                //Rotate the current rotation matrix to the right
-                glm::vec3 axis = getRotateAxis(branchNum);
-                float newAngle = getRandomAngle(branchNum, ANGLE);
-                currState.rotate = glm::rotate(newAngle, axis) * currState.rotate;
                 if (currState.length == 0) {
                     //Need to update initial state for branch that hasn't been drawn yet
-                    currState.initialRotate = currState.rotate;
+                    currState.initialOrientation = currState.orientation;
                 }
                 break;
             }
-            case '[': {
+            case TURTLE_PUSH: {
                 //Save the current state for later (splitting off into child branches)
                 prevStates.push_back(currState);
-                currState.scale = scale * currState.scale; //Scale down child branches
+                if (scaleBranches) {
+                    currState.scale *= SCALE_FACTOR; //Scale down child branches
+                }
                 currState = createNewBranchState(currState); //Initialize child branch state
                 break;
             }
-            case ']': {
-                //Resume parsing with the last saved state (the current branch is closed)
-                m_branchData.tip.push_back(getBranchTransform(model, currState)); // Pushes as a tip because it's the last of the branch.
-                buildLeaves(model, currState, branchNum);
+            case TURTLE_POP: {
+                //Resume with the last saved state (the current branch is closed)
+                addBranch(currState, BASIS_BRANCH, output.tip); // Pushes as a tip because it's the last of the branch.
+                uint32_t leafBegin = output.leaf.size();
+                addLeaves(currState, op.axis, output.leaf);
+                endSegment(currState, leafBegin, static_cast<uint8_t>(output.leaf.size() - leafBegin), output);
                 currState = prevStates.back();
                 prevStates.pop_back();
                 break;
             }
-        default:
-            if (std::find(forwardSymbols.begin(), forwardSymbols.end(), string[i]) != forwardSymbols.end()) {
-                branchNum++;
+            case TURTLE_FORWARD: {
+                float step;
+                if (op.flags & TurtleProgram::FLAG_VALUES) {
+                    const float *values = program.values(op);
+                    step = values[0];
+                    if (values[1] >= 0) {
+                        currState.scale = INIT_SCALE_FACTOR * glm::vec3(values[1], 1.f, values[1]);
+                        if (currState.length == 0) {
+                            //A branch that hasn't been drawn yet simply starts at the new width
+                            currState.initialScale = currState.scale;
+                        }
+                    }
+                } else {
+                    //A run of moves cannot start another branch after its first move, so it is one longer step
+                    step = static_cast<float>(op.arg);
+                }
 
-                //For "Forward" symbols, translate a small distance in the current direction
-                //Start a new line if the scale or rotation matrices are different from the initial branch transformation
+                //Translate a small distance in the current direction
+                //Start a new line if the scale or orientation are different from the initial branch transformation
                 //Otherwise, continue the current line
-                bool isNewBranch =
-                        currState.length != 0 &&
-                        !(matEq(currState.scale, currState.initialScale) && matEq(currState.rotate, currState.initialRotate));
+                bool isNewBranch = currState.length != 0 && !hasInitialTransform(currState);
 
                 if (isNewBranch) {
                     LState branchInitState = getBranchInitialStateTransforms(currState);
 
                     // When we are in the middle of a branch, we want to push it as a cylinder. Potentially questionable
                     // But it looks ok
-                    std::string bracket = "]";
-                    if (i < string.size() - 1 && string[i+1] != bracket[0]) {
-                        bodyStates.push_back(branchInitState);
+                    if (op.flags & TurtleProgram::FLAG_CONTINUES) {
+                        output.bodyStates.push_back(branchInitState);
                     } else { // otherwise, we push as a tip.
-                        m_branchData.tip.push_back(getBranchTransform(model, branchInitState));
+                        addBranch(branchInitState, BASIS_BRANCH, output.tip);
                     }
+                    endSegment(branchInitState, 0, 0, output);
                     currState = createNewBranchState(currState);
                 }
+                if (currState.length == 0) {
+                    startSegment(currState, output);
+                }
 
-                glm::mat4 transform = currState.translate * currState.rotate * currState.scale;
                 //This is the translation out from the current branch
-                glm::vec3 wscTranslate = (transform * translate - transform * origin).xyz();
-                currState.translate = glm::translate(identity, wscTranslate) * currState.translate;
-                currState.length += BRANCH_LENGTH;
+                glm::vec3 wscTranslate = currState.orientation * (currState.scale * TRANSLATE);
+                currState.position += step * wscTranslate;
+                currState.length += step * BRANCH_LENGTH;
                 break;
-            } else {
-                std::cout << "BAD LSYSTEM SYMBOL: " << string[i] << std::endl;
             }
-            break;
         }
-
     }
 
+    state = currState;
+}
+
+/**
+ * Records the cylinders of the branches drawn in the middle of a branch, and the cone that caps
+ * each of them.
+ * @brief Tree::capBodies
+ * @param output output whose bodyStates are recorded into its body and cone
+ */
+void Tree::capBodies(TurtleOutput &output) {
     // Going through all the ones that are cylinders, and places a cone at the top
-    for (size_t i = 0; i < bodyStates.size(); i++) {
-        LState savedState = bodyStates[i];
+    for (size_t i = 0; i < output.bodyStates.size(); i++) {
+        LState savedState = output.bodyStates[i];
         // Pushes cylinder to be rendered.
-        m_branchData.body.push_back(getBranchTransform(model, savedState));
-
-        // Trial and error for numbers
-        glm::mat4 newScale = glm::scale(glm::mat4(), glm::vec3(1.f, .2f, 1.f));
-        glm::mat4 newTrans = glm::translate(glm::mat4(), glm::vec3(0.f, Tree::BRANCH_LENGTH * .43f, 0.f));
-
+        addBranch(savedState, BASIS_BRANCH, output.body);
         savedState.length += BRANCH_LENGTH;
-        //This is the translation out from the current branch
-        glm::mat4 t = getBranchTransform(model, savedState)  * newTrans * newScale;
-        m_branchData.tip.push_back(t);
+        addBranch(savedState, BASIS_CONE, output.cone);
     }
+}
 
-    if (currState.length != 0) {
-        m_branchData.tip.push_back(getBranchTransform(model, currState));
-    }
-    if (prevStates.size() != 0) {
-        std::cout << "Missed " << prevStates.size() << " cached states" << std::endl;
-    }
+/**
+ * Starts a skeleton segment for a branch about to move for the first time. Its parent is the
+ * segment the state grew from, and the state carries the new segment from now on.
+ * @brief Tree::startSegment
+ * @param state state of the branch
+ * @param output output of the part of the program the turtle is in
+ */
+void Tree::startSegment(LState &state, TurtleOutput &output) {
+    uint64_t segment = (uint64_t(output.part) << 32) | output.segmentParents.size();
+    output.segmentParents.push_back(state.segment);
+    state.segment = segment;
 }
 
+/**
+ * Records where the segment of a branch ends: the axis of the cylinder addBranch() draws for the
+ * state, which is centered on its position. Branches that never moved have no segment.
+ * @brief Tree::endSegment
+ * @param state state of the branch as it is drawn
+ * @param leafBegin first of the leaves at its tip in the leaves of output
+ * @param leafCount number of leaves at its tip
+ * @param output output of the part of the program the turtle is in
+ */
+void Tree::endSegment(const LState &state, uint32_t leafBegin, uint8_t leafCount, TurtleOutput &output) {
+    if (state.length == 0) {
+        return;
+    }
+    glm::vec3 axis = glm::normalize(state.orientation) * glm::vec3(0, .5f * BRANCH_LENGTH * state.length * state.scale.y, 0);
+    // The unit cylinder has a radius of .5
+    float radius = .5f * std::max(state.scale.x, state.scale.z);
+    output.segmentEnds.push_back({ state.segment, state.position - axis, state.position + axis, radius, leafBegin, leafCount });
+}
 
 /**
- * Adds the leaf data to the member variable. If it's not a 2D array, will add
- * 3 leaves per branch.
- * @brief Tree::buildLeaves
- * @param model
- * @param state
- * @param branchLevel
+ * Collects the branch tips that have leaves from the skeleton and the leaves the turtle recorded,
+ * in the order of the skeleton.
+ * @brief Tree::collectLeafTips
  */
-void Tree::buildLeaves(const glm::mat4 &model, const LState &state, const int branchLevel) {
-    m_leafData.push_back(getLeafTransform(model, state, branchLevel, TOP));
+void Tree::collectLeafTips() {
+    const Skeleton &skeleton = *m_skeleton;
+    std::vector<LeafTip> &tips = *m_leafTips;
+    tips.clear();
+    for (size_t s = 0; s < skeleton.size(); s++) {
+        if (skeleton.leafCount[s] == 0) {
+            continue;
+        }
+        glm::vec3 position;
+        glm::quat orientation;
+        uint32_t basis;
+        uint32_t axis = 0;
+        if (skeleton.leafCount[s] > 1) {
+            // The left leaf comes after the top one, with the basis of its axis
+            m_output.leaf.get(skeleton.leafBegin[s] + 1, position, orientation, basis);
+            axis = basis - (BASIS_LEAF + 1);
+        }
+        m_output.leaf.get(skeleton.leafBegin[s], position, orientation, basis);
+        orientation = glm::normalize(orientation);
 
-    // In the 2D case (binary tree) we do not render all the leaves for the sake of space.
-    if (!m_is2D) {
-        m_leafData.push_back(getLeafTransform(model, state, branchLevel, LEFT));
-        m_leafData.push_back(getLeafTransform(model, state, branchLevel, RIGHT));
+        LeafTip tip;
+        tip.position = position;
+        for (int i = 0; i < 4; i++) {
+            tip.orientation[i] = static_cast<int16_t>(glm::round(glm::clamp(orientation[i], -1.f, 1.f) * 32767.f));
+        }
+        tip.axis = axis;
+        tip.level = std::min(skeleton.depth[s], 255u);
+        tip.padding = 0;
+        tips.push_back(tip);
     }
 }
 
 /**
- * Gets the transformation of the leaf, given the branch state.
- * @brief Tree::getLeafTransform
- * @param model
- * @param state
- * @param branchNum
- * @return
+ * Sets the kernel instances are emitted with. Unsupported kernels fall back to the scalar one,
+ * which is also the reference the others can be checked against.
+ * @brief Tree::setInstanceKernel
  */
-glm::mat4 Tree::getLeafTransform(const glm::mat4 &model, const LState &state, const int branchLevel, LeafDir dir) {
-    if (state.length == 0) {
-        return glm::mat4(0);
+void Tree::setInstanceKernel(InstanceKernel kernel) {
+    m_kernel = InstanceBatch::isSupported(kernel) ? kernel : KERNEL_SCALAR;
+}
+
+/**
+ * Sets the number of threads the turtle runs subtrees on. Values below 1 use one thread per
+ * hardware core.
+ * @brief Tree::setThreadCount
+ * @param threads number of threads
+ */
+void Tree::setThreadCount(int threads) {
+    if (threads < 1) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
     }
+    m_threads = threads;
+}
 
+/**
+ * Gets the placement of a leaf relative to the end of its branch.
+ * @brief Tree::getLeafOffset
+ * @param leafAxis axis the side leaves turn on
+ * @param dir which of the leaves of a branch
+ * @param leafScale width of the leaf
+ */
+glm::mat4 Tree::getLeafOffset(const glm::vec3 &leafAxis, LeafDir dir, float leafScale) {
     // Positioning a leaf to be at the end of the branch.
     glm::mat4 INIT_ROTATE = glm::rotate(glm::radians(90.f), Tree::ROTATE_AXES[2]);
     glm::mat4 INIT_TRANSLATE = glm::translate(glm::mat4(), glm::vec3(0.f, 7.5f + 1.f * Tree::BRANCH_LENGTH, 0.f));
-    glm::mat4 INIT_SCALE = glm::scale(glm::mat4(), glm::vec3(m_leafScale, .8, 1.f)); // Scales to size of branches.
+    glm::mat4 INIT_SCALE = glm::scale(glm::mat4(), glm::vec3(leafScale, .8, 1.f)); // Scales to size of branches.
 
     if (dir == LEFT) { // A leaf for the left side
-        INIT_ROTATE = glm::rotate(glm::radians(50.f), getRotateAxis(branchLevel - 1));
+        INIT_ROTATE = glm::rotate(glm::radians(50.f), leafAxis);
         INIT_TRANSLATE = glm::translate(glm::mat4(), glm::vec3(1.f,  Tree::BRANCH_LENGTH, 0.f));
-        INIT_SCALE = glm::scale(glm::mat4(), glm::vec3(m_leafScale, .8, 1.f)); // Scales to size of branches.
+        INIT_SCALE = glm::scale(glm::mat4(), glm::vec3(leafScale, .8, 1.f)); // Scales to size of branches.
     } else if (dir == RIGHT) { // A leaf for right side
-        INIT_ROTATE = glm::rotate(glm::radians(-50.f), getRotateAxis(branchLevel - 1));
+        INIT_ROTATE = glm::rotate(glm::radians(-50.f), leafAxis);
         INIT_TRANSLATE = glm::translate(glm::mat4(), glm::vec3(-1.f,  Tree::BRANCH_LENGTH, 0.f));
-        INIT_SCALE = glm::scale(glm::mat4(), glm::vec3(m_leafScale, .8, 1.f)); // Scales to size of branches.
+        INIT_SCALE = glm::scale(glm::mat4(), glm::vec3(leafScale, .8, 1.f)); // Scales to size of branches.
     }
     glm::mat4 scale = glm::scale(glm::mat4(), glm::vec3(.01f, .01f, .01f));
-    glm::mat4 rotate = state.rotate;
-    glm::mat4 translate = state.translate;
-    return translate * rotate * scale * INIT_TRANSLATE * INIT_ROTATE * INIT_SCALE * model;
+    return scale * INIT_TRANSLATE * INIT_ROTATE * INIT_SCALE;
 }
 
 
-//Calculates the overall transformation matrix of a branch given its current state
-glm::mat4 Tree::getBranchTransform (const glm::mat4 &model, const LState &state) {
+//Builds the translation and rotation of a state as one matrix. Turns leave the orientation
+//slightly off unit length, so it is normalized here rather than on every turn.
+glm::mat4 Tree::getPlacement(const LState &state) {
+    glm::mat4 placement = glm::mat4_cast(glm::normalize(state.orientation));
+    placement[3] = glm::vec4(state.position, 1.f);
+    return placement;
+}
+
+//Records a branch to be emitted with the given basis, which scales it to its length
+void Tree::addBranch(const LState &state, uint32_t basis, InstanceBatch &batch) {
     if (state.length == 0) {
-        return glm::mat4(0);
+        batch.add(glm::vec3(0), glm::quat(), glm::vec3(0), BASIS_ZERO);
+        return;
     }
-    glm::mat4 selfScale = glm::scale(glm::mat4(), { 1.f, BRANCH_LENGTH * state.length, 1.f });
-    return state.translate * state.rotate * state.scale * (selfScale) * model;
-};
+    glm::vec3 selfScale = { 1.f, BRANCH_LENGTH * state.length, 1.f };
+    batch.add(state.position, state.orientation, state.scale * selfScale, basis);
+}
+
+//Records the leaves at the end of a branch: one on top and, unless the tree is 2D, one on each side
+void Tree::addLeaves(const LState &state, uint8_t leafAxis, InstanceBatch &leaves) {
+    uint32_t top = BASIS_LEAF;
+    uint32_t left = BASIS_LEAF + 1 + leafAxis;
+    uint32_t right = left + ROTATE_AXES.size();
+    if (state.length == 0) {
+        top = left = right = BASIS_ZERO;
+    }
+    const glm::vec3 one = glm::vec3(1.f);
+    leaves.add(state.position, state.orientation, one, top);
+
+    // In the 2D case (binary tree) we do not render all the leaves for the sake of space.
+    if (!m_is2D) {
+        leaves.add(state.position, state.orientation, one, left);
+        leaves.add(state.position, state.orientation, one, right);
+    }
+}
+
+/**
+ * Gets the transforms the recorded instances are emitted with, in the order of the basis indices:
+ * all zeros, the model, the cone on top of a cylinder, the top leaf, then the left leaves and the
+ * right leaves for every rotation axis.
+ * @brief Tree::getInstanceBases
+ * @param model the initial model matrix
+ */
+std::vector<glm::mat4> Tree::getInstanceBases(const glm::mat4 &model) {
+    // Trial and error for numbers
+    glm::mat4 newScale = glm::scale(glm::mat4(), glm::vec3(1.f, .2f, 1.f));
+    glm::mat4 newTrans = glm::translate(glm::mat4(), glm::vec3(0.f, Tree::BRANCH_LENGTH * .43f, 0.f));
+
+    std::vector<glm::mat4> bases = { glm::mat4(0), model, model * newTrans * newScale };
+    std::vector<glm::mat4> leafBases = getLeafBases(model, m_leafScale);
+    bases.insert(bases.end(), leafBases.begin(), leafBases.end());
+    return bases;
+}
+
+/**
+ * Gets the placement of every leaf relative to the end of its branch: the top leaf, then the left
+ * leaves and the right leaves for every rotation axis. The GPU leaves (see LeafTip) take these as
+ * a uniform, so a new leaf size only needs these 11 transforms again.
+ * @brief Tree::getLeafBases
+ * @param model the initial model matrix
+ * @param leafScale width of the leaves
+ */
+std::vector<glm::mat4> Tree::getLeafBases(const glm::mat4 &model, float leafScale) {
+    std::vector<glm::mat4> bases;
+    bases.push_back(getLeafOffset(ROTATE_AXES[0], TOP, leafScale) * model);
+    for (LeafDir dir : { LEFT, RIGHT }) {
+        for (const glm::vec3 &axis : ROTATE_AXES) {
+            bases.push_back(getLeafOffset(axis, dir, leafScale) * model);
+        }
+    }
+    return bases;
+}
+
+/**
+ * Turns recorded instances into transforms, split across the threads for long batches.
+ * @brief Tree::emitInstances
+ * @param batch recorded instances
+ * @param bases transforms from getInstanceBases()
+ * @param out replaced by one transform per instance
+ */
+void Tree::emitInstances(const InstanceBatch &batch, const std::vector<glm::mat4> &bases, std::vector<glm::mat4> &out) {
+    const size_t size = batch.size();
+    out.resize(size);
+    if (m_threads <= 1 || size < PARALLEL_MIN_OPS) {
+        batch.emit(bases, 0, size, out.data(), m_kernel);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < m_threads; t++) {
+        threads.emplace_back([&, t]() {
+            batch.emit(bases, size * t / m_threads, size * (t + 1) / m_threads, out.data(), m_kernel);
+        });
+    }
+    batch.emit(bases, 0, size / m_threads, out.data(), m_kernel);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
 
 //Produces an LState with all of the initial values of the given state
 //except for the length
 LState Tree::getBranchInitialStateTransforms(const LState &state) {
     LState initState = state;
-    initState.rotate = initState.initialRotate;
+    initState.orientation = initState.initialOrientation;
     initState.scale = initState.initialScale;
     return initState;
 };
@@ -253,15 +992,15 @@ LState Tree::getBranchInitialStateTransforms(const LState &state) {
 //Initializes the state of a child branching off from the given state
 LState Tree::createNewBranchState(const LState &state) {
     LState newState = state;
-    newState.initialRotate = newState.rotate;
+    newState.initialOrientation = newState.orientation;
     newState.initialScale = newState.scale;
     newState.length = 0;
     return newState;
 };
 
-// Returns a struct of all the branch data.
-Branch Tree::getBranchData() {
-    return m_branchData;
+// Returns a struct of all the branch data. It stays valid until the next build.
+const Branch &Tree::getBranchData() const {
+    return *m_branchData;
 }
 
 /**
@@ -270,113 +1009,249 @@ Branch Tree::getBranchData() {
  * @param treeOption index of selected tree option in the ui combo box
  */
 void Tree::addTreeOptionRule(int treeOption){
-    m_lsystem.clearRules();
+    m_isParametric = setUpParametricLSystem(m_parametric, treeOption);
+    m_is2D = setUpLSystem(m_lsystem, treeOption);
+}
+
+/**
+ * Sets the axiom and rules of the given parametric L-system for a tree option.
+ * @brief Tree::setUpParametricLSystem
+ * @param lsystem parametric L-system to set up
+ * @param treeOption index of selected tree option in the ui combo box
+ * @return whether the tree option is a parametric one
+ */
+bool Tree::setUpParametricLSystem(ParametricLSystem &lsystem, int treeOption){
+    lsystem.clearRules();
+    switch (treeOption){
+        //Parametric Tree: every fork is shorter and thinner, and growth stops once branches get tiny
+        case 6:
+            lsystem.setAxiom("A(1,1)");
+            lsystem.addRule("A(l,w)", "l > 0.05", "F(l,w)[+(35)A(l*0.7,w*0.7)][-(25)A(l*0.6,w*0.7)]");
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Sets the axiom and rules of the given L-system for a tree option.
+ * @brief Tree::setUpLSystem
+ * @param lsystem L-system to set up
+ * @param treeOption index of selected tree option in the ui combo box
+ * @return whether the tree is drawn in 2D
+ */
+bool Tree::setUpLSystem(LSystem &lsystem, int treeOption){
+    bool is2D = false;
+    lsystem.clearRules();
     switch (treeOption){
         //Binary tree
         case 0:
-            m_lsystem.setAxiom("X");
-            m_lsystem.addRule("F", "F");
-            m_lsystem.addRule("X", "F[-X][+X]");
-            m_is2D = true;
+            lsystem.setAxiom("X");
+            lsystem.addRule("F", "F");
+            lsystem.addRule("X", "F[-X][+X]");
+            is2D = true;
             break;
         //Arrow Weed
         case 1:
-            m_lsystem.setAxiom("X");
+            lsystem.setAxiom("X");
             // Temporary visual patch as the FF creates this long string
-            m_lsystem.addRule("F", "F");
-            m_lsystem.addRule("F", "F[+X]");
-            m_lsystem.addRule("F", "F[-X]");
-            m_lsystem.addRule("X", "F[+X][-X]F");
+            lsystem.addRule("F", "F");
+            lsystem.addRule("F", "F[+X]");
+            lsystem.addRule("F", "F[-X]");
+            lsystem.addRule("X", "F[+X][-X]F");
             // Original Rules
-//            m_lsystem.addRule("F", "FF");
-//            m_lsystem.addRule("X", "F[+X][-X]FX");
-            m_is2D = false;
+//            lsystem.addRule("F", "FF");
+//            lsystem.addRule("X", "F[+X][-X]FX");
+            is2D = false;
             break;
         //Fuzzy Weed
         case 2:
-            m_lsystem.setAxiom("X");
-            m_lsystem.addRule("X", "F[+X][-X]");
-            m_lsystem.addRule("F", "F[+X]");
-            m_lsystem.addRule("F", "F[-X]F");
+            lsystem.setAxiom("X");
+            lsystem.addRule("X", "F[+X][-X]");
+            lsystem.addRule("F", "F[+X]");
+            lsystem.addRule("F", "F[-X]F");
 
 
 
-            m_is2D = false;
+            is2D = false;
             break;
         //Wavy Seaweed
         case 3:
-            m_lsystem.setAxiom("F");
-            m_lsystem.addRule("F", "FF-[-F+F+F]+[+F-F-F]");
-            m_is2D = false;
+            lsystem.setAxiom("F");
+            lsystem.addRule("F", "FF-[-F+F+F]+[+F-F-F]");
+            is2D = false;
             break;
         //Twiggy weed
         case 4:
-            m_lsystem.setAxiom("X");
-//            m_lsystem.addRule("F", "FF"); // Original Rule
+            lsystem.setAxiom("X");
+//            lsystem.addRule("F", "FF"); // Original Rule
             // Temporary visual patch as the FF creates this long string
-            m_lsystem.addRule("F", "F");
-            m_lsystem.addRule("F", "F[X]");
+            lsystem.addRule("F", "F");
+            lsystem.addRule("F", "F[X]");
             // End visual patch
-            m_lsystem.addRule("X", "F[-X]F[-X]+X");
-            m_is2D = false;
+            lsystem.addRule("X", "F[-X]F[-X]+X");
+            is2D = false;
             break;
         //Stochastic Fuzzy Weed
         case 5:
-            m_lsystem.setAxiom("X");
+            lsystem.setAxiom("X");
 
             // Temporary visual patch as the FF creates this long string
-            m_lsystem.addRule("F", "F");
-            m_lsystem.addRule("F", "F[X]");
+            lsystem.addRule("F", "F");
+            lsystem.addRule("F", "F[X]");
             // End visual patch
 
-            m_lsystem.addRule("X", "F[-X]F[-X]");
-            m_lsystem.addRule("X", "F[-X]F[-X]+X");
-            m_lsystem.addRule("X", "F[-X]F[-X]-X");
+            lsystem.addRule("X", "F[-X]F[-X]");
+            lsystem.addRule("X", "F[-X]F[-X]+X");
+            lsystem.addRule("X", "F[-X]F[-X]-X");
 
-            m_is2D = false;
-            m_is2D = false;
+            is2D = false;
             break;
 
     }
+    return is2D;
+}
+
+/**
+ * Predicts how many bytes of transforms a tree option would produce at the given recursion depth,
+ * without building it. Counts one instance per forward symbol and per closed branch, plus the
+ * leaves of every closed branch, which bounds what buildTree emits. Parametric tree options are
+ * not predicted and report 0; their rule conditions bound their size instead.
+ * @brief Tree::predictOutputBytes
+ * @param treeOption index of selected tree option in the ui combo box
+ * @param recursions recursion depth
+ */
+double Tree::predictOutputBytes(int treeOption, int recursions) {
+    ParametricLSystem parametric;
+    if (setUpParametricLSystem(parametric, treeOption)) {
+        return 0;
+    }
+    LSystem lsystem;
+    bool is2D = setUpLSystem(lsystem, treeOption);
+    GrowthPrediction prediction = lsystem.predictGrowth(recursions);
+
+    double forward = 0;
+    for (char c : lsystem.getRules().symbols()) {
+        forward += prediction.count(c);
+    }
+    double closedBranches = prediction.count(']');
+    double instances = forward + closedBranches + closedBranches * (is2D ? 1 : 3);
+    return instances * sizeof(glm::mat4);
+}
+
+// Returns a list of transformations for the leaves. It stays valid until the next build.
+const std::vector<glm::mat4> &Tree::getLeafData() const {
+    return *m_leafData;
+}
+
+/**
+ * Identifies the current branch, leaf and skeleton data: it goes up whenever they change, so anything
+ * derived from them only needs redoing when it differs from the generation it was made from.
+ * @brief Tree::getGeneration
+ */
+uint64_t Tree::getGeneration() const {
+    return m_generation;
 }
 
-// Returns a list of transformations for the leaves.
-std::vector<glm::mat4> Tree::getLeafData() {
+/**
+ * Shares the branch data of the last build without copying it. The tree never changes data it
+ * has shared, so it stays as it is after later builds.
+ * @brief Tree::shareBranchData
+ */
+std::shared_ptr<const Branch> Tree::shareBranchData() {
+    return m_branchData;
+}
+
+/**
+ * Shares the leaf data of the last build without copying it, like shareBranchData().
+ * @brief Tree::shareLeafData
+ */
+std::shared_ptr<const std::vector<glm::mat4>> Tree::shareLeafData() {
     return m_leafData;
 }
 
-// Returns the access to rotate the branch upon. In the 2 dimensional space
-// it is always along the same axis.
-glm::vec3 Tree::getRotateAxis(const int branchNum) {
+// Returns the skeleton of the branches. It stays valid until the next build.
+const Skeleton &Tree::getSkeleton() const {
+    return *m_skeleton;
+}
+
+/**
+ * Shares the skeleton of the last build without copying it, like shareBranchData().
+ * @brief Tree::shareSkeleton
+ */
+std::shared_ptr<const Skeleton> Tree::shareSkeleton() {
+    return m_skeleton;
+}
+
+// Returns the tips with leaves of the last build. They stay valid until the next build.
+const std::vector<LeafTip> &Tree::getLeafTips() const {
+    return *m_leafTips;
+}
+
+/**
+ * Shares the leaf tips of the last build without copying them, like shareBranchData().
+ * @brief Tree::shareLeafTips
+ */
+std::shared_ptr<const std::vector<LeafTip>> Tree::shareLeafTips() {
+    return m_leafTips;
+}
+
+// Returns the number of leaves at the end of every closed branch: only the top one in 2D.
+int Tree::getLeavesPerTip() const {
+    return m_is2D ? 1 : 3;
+}
+
+/**
+ * Sets whether builds make the leaf transforms. Without them the leaves can only be drawn from
+ * the leaf tips, but the leaf size no longer affects the build, and the leaf data is dropped.
+ * @brief Tree::setLeafMatrices
+ */
+void Tree::setLeafMatrices(bool leafMatrices) {
+    if (leafMatrices && !m_leafMatrices) {
+        m_dirty |= STAGE_LEAVES;
+    } else if (!leafMatrices && m_leafMatrices) {
+        detachOutput(STAGE_LEAVES);
+        std::vector<glm::mat4>().swap(*m_leafData);
+    }
+    m_leafMatrices = leafMatrices;
+}
+
+// Returns the index in ROTATE_AXES of the axis a turn rotates the branch upon. In the 2 dimensional
+// space it is always along the same axis.
+uint8_t Tree::getRotateAxisIndex(const int branchNum) {
     if (m_is2D) {
-       return Tree::ROTATE_AXES[2];
+       return 2;
     }
-    return Tree::ROTATE_AXES[branchNum % (ROTATE_AXES.size() - 1)];
+    return branchNum % (ROTATE_AXES.size() - 1);
 }
 
-//Determines if two matrices are equal within epsilon
-bool Tree::matEq(const glm::mat4 &A, const glm::mat4 &B) {
-    float epsilon=1e-4;
-    int height = 4;
-    for (int i = 0 ; i < height ; i++) {
-        if (!glm::all(glm::epsilonEqual(A[i], B[i], epsilon))) {
-            return false;
-        }
+// Returns a turn axis by its index in the opcodes: ROTATE_AXES first, then LOCAL_AXES.
+glm::vec3 Tree::getTurnAxis(const size_t index) {
+    if (index < ROTATE_AXES.size()) {
+        return ROTATE_AXES[index];
     }
-    return true;
+    return LOCAL_AXES[index - ROTATE_AXES.size()];
+}
+
+//Determines if the orientation and scale of a state are still those its branch started with, within epsilon.
+//A quaternion component moves half as far as the matrix entries for the same turn, hence the smaller epsilon.
+bool Tree::hasInitialTransform(const LState &state) {
+    float epsilon=1e-4;
+    return glm::all(glm::epsilonEqual(state.scale, state.initialScale, epsilon)) &&
+            glm::all(glm::epsilonEqual(state.orientation, state.initialOrientation, epsilon * .5f));
 };
 
-// Returns some variance to the original angle by some random degree.
-// Potentially let the RANGE be decided by the UI. Not using rn.
-float Tree::getRandomAngle(const int &branchNum, const float &angle) {
+// Returns some variance in degrees to add to the angle of a turn at a branch number. The jitter is
+// keyed on the branch number, so the same seed always gives the same tree.
+int Tree::getAngleJitter(const int branchNum) {
     int MAX_LEVEL = 10; // Value was determined by trial and error
     if (branchNum < MAX_LEVEL) { // Only creates a wider angle if we are deeper in tree.
-        return angle;
+        return 0;
     }
-    int RANGE = 5;
-    std::default_random_engine generator;
-    std::uniform_int_distribution<int> distribution(0, RANGE);
-    int newAngle = glm::radians(distribution(generator) * 1.f);
-    return angle + newAngle;
-};
+    return m_random.uniformInt(ANGLE_JITTER_DEGREES, ANGLE_STREAM, branchNum);
+}
+
+// Whether the build in progress has been cancelled from another thread.
+bool Tree::isCancelled() const {
+    return m_cancel && m_cancel->load(std::memory_order_relaxed);
+}
 
@@ -1,62 +1,240 @@
 #ifndef TREE_H
 #define TREE_H
 
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 #include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
 #include "LSystem/LSystem.h"
+#include "LSystem/ParametricLSystem.h"
+#include "lib/CounterRandom.h"
+#include "TurtleProgram.h"
+#include "InstanceBatch.h"
+#include "Settings.h"
 
+/**
+ * Turtle state. Matrices are only built from it when a branch or leaf is emitted, so copying a
+ * state on every branch is 80 bytes instead of five matrices.
+ */
 struct LState {
-    glm::mat4 translate;
-    glm::mat4 rotate;
-    glm::mat4 scale;
+    glm::vec3 position;
     float length;
+    glm::quat orientation;
+    glm::vec3 scale;
 
-    glm::mat4 initialRotate;
-    glm::mat4 initialScale;
+    // Orientation and scale at the start of the current branch
+    glm::quat initialOrientation;
+    glm::vec3 initialScale;
+
+    // Skeleton segment of the current branch once it has moved, before that the one it grows from
+    uint64_t segment;
 };
 
 enum LeafDir { TOP, LEFT, RIGHT };
 
+/**
+ * Stages of building a tree. A stage keeps its result until something it depends on changes, and
+ * redoing it redoes the stages after it that use its result.
+ */
+enum TreeStage : unsigned {
+    STAGE_PROGRAM = 1,  // expanding and compiling the L-system: tree option, seed, recursions
+    STAGE_TURTLE = 2,   // running the turtle over the program: angle
+    STAGE_BRANCHES = 4, // branch transforms from what the turtle recorded: model matrix
+    STAGE_LEAVES = 8,   // leaf transforms from what the turtle recorded: model matrix, leaf size
+    ALL_STAGES = 15
+};
+
 struct Branch {
     std::vector<glm::mat4> body;
     std::vector<glm::mat4> tip;
 };
 
+/**
+ * Branch skeleton of a tree, one segment per branch cylinder that is drawn (each body and each
+ * tip), as one array per field. Segments are in the order the turtle starts them, so a parent
+ * always comes before its children and the subtree of a segment is the segments from it up to
+ * its subtreeEnd. Points are in the tree's own space, before the model matrix, at the two ends of
+ * the drawn cylinder.
+ */
+struct Skeleton {
+    std::vector<int32_t> parent;       // -1 for the segments the tree starts with
+    std::vector<uint32_t> depth;       // number of segments between it and the ground
+    std::vector<glm::vec3> start;
+    std::vector<glm::vec3> end;
+    std::vector<float> radius;
+    std::vector<uint32_t> subtreeEnd;  // one past the last segment of its subtree
+    std::vector<glm::vec3> subtreeMin; // bounding box of the cylinders of its subtree
+    std::vector<glm::vec3> subtreeMax;
+    std::vector<uint32_t> leafBegin;   // first of its leaves in the leaf data, 0 if it has none
+    std::vector<uint8_t> leafCount;    // leaves at its tip, 0 unless it closes a bracketed branch
+
+    size_t size() const { return parent.size(); }
+    void clear() { resize(0); }
+    void resize(size_t size) {
+        parent.resize(size);
+        depth.resize(size);
+        start.resize(size);
+        end.resize(size);
+        radius.resize(size);
+        subtreeEnd.resize(size);
+        subtreeMin.resize(size);
+        subtreeMax.resize(size);
+        leafBegin.resize(size);
+        leafCount.resize(size);
+    }
+};
+
+/**
+ * A branch tip with leaves, for drawing its leaves on the GPU from much less than their
+ * transforms: leaf i of the tip is placement(position, orientation) * getLeafBases()[slot], where
+ * the slot is 0 for the top leaf, 1 + axis for the left one and 1 + axes + axis for the right one.
+ */
+struct LeafTip {
+    glm::vec3 position;
+    int16_t orientation[4]; // unit quaternion x, y, z, w as normalized shorts
+    uint8_t axis;           // index in the rotation axes of the axis the side leaves turn on
+    uint8_t level;          // depth of the branch in the skeleton, at most 255
+    uint16_t padding;
+};
+
+/**
+ * Where the turtle closed a skeleton segment. Segment ids are tagged with the part of the program
+ * that started the segment (see TurtleOutput), which may not be the part that closes it.
+ */
+struct SegmentEnd {
+    uint64_t segment;
+    glm::vec3 start;
+    glm::vec3 end;
+    float radius;
+    uint32_t leafBegin; // in the leaves of the part that closed it
+    uint8_t leafCount;
+};
+
+/**
+ * Instances the turtle records over one part of a program.
+ */
+struct TurtleOutput {
+    InstanceBatch tip;
+    InstanceBatch leaf;
+    std::vector<LState> bodyStates; // branches drawn in the middle of a branch, capped by capBodies()
+    InstanceBatch body;
+    InstanceBatch cone;
+
+    // Skeleton segments by the ids the turtle gives them: the part number in the upper 32 bits and
+    // the index into segmentParents of that part in the lower ones.
+    uint32_t part = 0;
+    std::vector<uint64_t> segmentParents; // of the segments started here, by id or NO_SEGMENT
+    std::vector<SegmentEnd> segmentEnds;  // of the segments closed here
+
+    static const uint64_t NO_SEGMENT = ~uint64_t(0);
+
+    void clear() {
+        tip.clear();
+        leaf.clear();
+        bodyStates.clear();
+        body.clear();
+        cone.clear();
+        part = 0;
+        segmentParents.clear();
+        segmentEnds.clear();
+    }
+};
+
 class Tree
 {
+    friend class TreeBenchmarks; // times the stages one at a time, see benchmarks/
 public:
     Tree();
     ~Tree();
     void buildTree(const glm::mat4 &model, const float leafScale);
-    Branch getBranchData();
-    std::vector<glm::mat4> getLeafData();
+    bool buildTree(const Settings &treeSettings, const glm::mat4 &model, const float leafScale,
+                   const std::atomic<bool> *cancel);
+    const Branch &getBranchData() const;
+    const std::vector<glm::mat4> &getLeafData() const;
+    uint64_t getGeneration() const;
+    std::shared_ptr<const Branch> shareBranchData();
+    std::shared_ptr<const std::vector<glm::mat4>> shareLeafData();
+    const Skeleton &getSkeleton() const;
+    std::shared_ptr<const Skeleton> shareSkeleton();
+    const std::vector<LeafTip> &getLeafTips() const;
+    std::shared_ptr<const std::vector<LeafTip>> shareLeafTips();
+    int getLeavesPerTip() const;
+    void setLeafMatrices(bool leafMatrices);
+    static std::vector<glm::mat4> getLeafBases(const glm::mat4 &model, float leafScale);
     void addTreeOptionRule(int treeOption);
+    static double predictOutputBytes(int treeOption, int recursions);
+    void setThreadCount(int threads);
+    void setInstanceKernel(InstanceKernel kernel);
 private:
+    static bool setUpLSystem(LSystem &lsystem, int treeOption);
+    static bool setUpParametricLSystem(ParametricLSystem &lsystem, int treeOption);
+    template <typename Source>
+    void compile(Source &source, TurtleProgram &program);
+    void compileTree();
+    void compileSequence();
+    void run(const TurtleProgram &program);
+    void emitTree(const glm::mat4 &model, unsigned stages);
+    void detachOutput(unsigned stages);
+    void runRange(const TurtleProgram &program, size_t begin, size_t end, const std::vector<glm::quat> &turns,
+                  LState &state, std::vector<LState> &prevStates, TurtleOutput &output);
+    void capBodies(TurtleOutput &output);
+    void startSegment(LState &state, TurtleOutput &output);
+    void endSegment(const LState &state, uint32_t leafBegin, uint8_t leafCount, TurtleOutput &output);
+    void collectLeafTips();
+    void addBranch(const LState &state, uint32_t basis, InstanceBatch &batch);
+    void addLeaves(const LState &state, uint8_t leafAxis, InstanceBatch &leaves);
+    std::vector<glm::mat4> getInstanceBases(const glm::mat4 &model);
+    void emitInstances(const InstanceBatch &batch, const std::vector<glm::mat4> &bases, std::vector<glm::mat4> &out);
+
     static const float BRANCH_LENGTH;
     static const glm::vec3 SCALE_FACTOR;
+    static const glm::vec3 INIT_SCALE_FACTOR;
     static const glm::vec3 TRANSLATE;
     static const std::vector<glm::vec3> ROTATE_AXES;
+    static const std::vector<glm::vec3> LOCAL_AXES;
+    static const uint32_t ANGLE_STREAM;
+    static const int ANGLE_JITTER_DEGREES;
+    static const size_t PARALLEL_MIN_OPS;
+    static const int CHUNKS_PER_THREAD;
+    static const size_t CANCEL_CHECK_INTERVAL;
 
     std::vector<glm::mat4> processBranch(const glm::mat4 &curr, const std::string &string);
-    glm::vec3 getRotateAxis(const int branchNum);
-    glm::mat4 getBranchTransform(const glm::mat4 &model, const LState &state);
-    glm::mat4 getLeafTransform(const glm::mat4 &model, const LState &state, const int branchLevel, LeafDir dir);
-    void buildLeaves(const glm::mat4 &model, const LState &state, const int branchLevel);
+    uint8_t getRotateAxisIndex(const int branchNum);
+    static glm::vec3 getTurnAxis(const size_t index);
+    static glm::mat4 getLeafOffset(const glm::vec3 &leafAxis, LeafDir dir, float leafScale);
 
     LState getBranchInitialStateTransforms(const LState &state);
     LState createNewBranchState(const LState &state);
-    bool matEq(const glm::mat4 &A, const glm::mat4 &B);
-    float getRandomAngle(const int &branchNum, const float &angle);
+    bool hasInitialTransform(const LState &state);
+    static glm::mat4 getPlacement(const LState &state);
+    int getAngleJitter(const int branchNum);
+    bool isCancelled() const;
 
+    Settings m_settings; // settings the tree is built with, so a build never reads them as they change
+    const std::atomic<bool> *m_cancel;
     LSystem m_lsystem;
-    std::vector <glm::mat4> m_leafData;
+    ParametricLSystem m_parametric;
+    CounterRandom m_random;
+    TurtleProgram m_program;
+    int m_threads;
+    InstanceKernel m_kernel;
+    TurtleOutput m_output; // instances of the last run, emitted again when only the model or leaf size change
+    unsigned m_dirty;      // stages to redo on the next build
+    uint64_t m_generation; // bumped whenever the branch, leaf or skeleton data change
+    glm::mat4 m_model;
+    std::shared_ptr<std::vector<glm::mat4>> m_leafData; // shared with snapshots, see detachOutput()
 
-    Branch m_branchData;
+    std::shared_ptr<Branch> m_branchData;
+    std::shared_ptr<Skeleton> m_skeleton;
+    std::shared_ptr<std::vector<LeafTip>> m_leafTips;
+    bool m_leafMatrices; // whether leaf transforms are built, or only the leaf tips
 //    std::vector<glm::mat4> m_branchData;
     float m_leafScale;
     bool m_is2D;
+    bool m_isParametric;
 
 
 };
@@ -0,0 +1,124 @@
+#include "TreeBuilder.h"
+
+TreeBuilder::TreeBuilder() :
+    m_stopping(false),
+    m_requests(0),
+    m_hasRequest(false),
+    m_requestSettings(settings),
+    m_requestLeafMatrices(true),
+    m_cancel(false),
+    m_worker(&TreeBuilder::work, this)
+{
+
+}
+
+TreeBuilder::~TreeBuilder() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_cancel = true;
+    }
+    m_wake.notify_one();
+    m_worker.join();
+}
+
+/**
+ * Asks for a tree with the given settings, superseding every earlier request. A build already
+ * running is cancelled.
+ * @brief TreeBuilder::request
+ * @param treeSettings settings to build the tree for, copied
+ * @param model the initial model matrix
+ * @param leafMatrices whether to build the leaf transforms, see Tree::setLeafMatrices()
+ */
+void TreeBuilder::request(const Settings &treeSettings, const glm::mat4 &model, bool leafMatrices) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requestSettings = treeSettings;
+        m_requestModel = model;
+        m_requestLeafMatrices = leafMatrices;
+        m_requests++;
+        m_hasRequest = true;
+        m_cancel = true;
+    }
+    m_wake.notify_one();
+}
+
+/**
+ * @brief TreeBuilder::takeFinished
+ * @return the tree of the latest request once it is built, or null if there is no new tree
+ */
+std::shared_ptr<const TreeSnapshot> TreeBuilder::takeFinished() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_ptr<const TreeSnapshot> finished = std::move(m_finished);
+    return finished;
+}
+
+/**
+ * Worker loop: builds the latest request, and keeps the tree only if no newer request came in
+ * while it was built.
+ * @brief TreeBuilder::work
+ */
+void TreeBuilder::work() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [this]() { return m_stopping || m_hasRequest; });
+        if (m_stopping) {
+            return;
+        }
+        Settings treeSettings = m_requestSettings;
+        glm::mat4 model = m_requestModel;
+        bool leafMatrices = m_requestLeafMatrices;
+        uint64_t request = m_requests;
+        m_hasRequest = false;
+        m_cancel = false;
+        lock.unlock();
+
+        std::shared_ptr<TreeSnapshot> snapshot;
+        m_tree.setLeafMatrices(leafMatrices);
+        if (!leafMatrices) {
+            m_compactedLeaves.reset();
+            m_drawnLeaves.reset();
+        }
+        if (m_tree.buildTree(treeSettings, model, treeSettings.leafSize, &m_cancel)) {
+            snapshot = std::make_shared<TreeSnapshot>();
+            snapshot->branches = m_tree.shareBranchData();
+            snapshot->leaves = m_tree.shareLeafData();
+            snapshot->skeleton = m_tree.shareSkeleton();
+            snapshot->drawnLeaves = leafMatrices ? compactLeaves(snapshot->leaves) : nullptr;
+            snapshot->leafTips = m_tree.shareLeafTips();
+            snapshot->leavesPerTip = m_tree.getLeavesPerTip();
+            snapshot->model = model;
+            snapshot->generation = m_tree.getGeneration();
+            snapshot->request = request;
+        }
+
+        lock.lock();
+        if (snapshot && request == m_requests) {
+            m_finished = snapshot;
+        }
+    }
+}
+
+/**
+ * Drops the all-zero transforms a branch that never grew leaves in the leaf data, so the renderer
+ * can upload the rest as they are. Done here rather than on the render thread, and only when the
+ * build actually made new leaves.
+ * @brief TreeBuilder::compactLeaves
+ * @param leaves leaf data of the tree
+ * @return the leaves to draw
+ */
+std::shared_ptr<const std::vector<glm::mat4>> TreeBuilder::compactLeaves(const std::shared_ptr<const std::vector<glm::mat4>> &leaves) {
+    if (leaves != m_compactedLeaves) {
+        const glm::mat4 zero = glm::mat4(0);
+        auto drawn = std::make_shared<std::vector<glm::mat4>>();
+        drawn->reserve(leaves->size());
+        for (const glm::mat4 &leaf : *leaves) {
+            if (leaf != zero) {
+                drawn->push_back(leaf);
+            }
+        }
+        m_compactedLeaves = leaves;
+        m_drawnLeaves = drawn;
+    }
+    return m_drawnLeaves;
+}
@@ -0,0 +1,63 @@
+#ifndef TREEBUILDER_H
+#define TREEBUILDER_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "Tree.h"
+
+/**
+ * A finished tree. It never changes once built, so the renderer can keep drawing it while the
+ * next one builds. Data a rebuild did not touch is shared with the snapshot before it.
+ */
+struct TreeSnapshot {
+    std::shared_ptr<const Branch> branches;
+    std::shared_ptr<const std::vector<glm::mat4>> leaves;
+    std::shared_ptr<const Skeleton> skeleton;
+    std::shared_ptr<const std::vector<glm::mat4>> drawnLeaves; // leaves without the all-zero ones of branches that never grew, null without leaf matrices
+    std::shared_ptr<const std::vector<LeafTip>> leafTips;
+    int leavesPerTip;
+    glm::mat4 model;     // model matrix the tree was built with, for Tree::getLeafBases()
+    uint64_t generation; // Tree::getGeneration() of the data
+    uint64_t request;    // number of the request it was built for
+};
+
+/**
+ * Builds trees on a worker thread so rendering goes on while they build. Only the latest request
+ * counts: a new one cancels the build in flight, and requests made while a build runs are
+ * coalesced into the newest. Finished trees are handed over whole as snapshots. The worker keeps
+ * one Tree, so a request only redoes the stages that depend on the settings that changed.
+ */
+class TreeBuilder
+{
+public:
+    TreeBuilder();
+    ~TreeBuilder();
+
+    void request(const Settings &treeSettings, const glm::mat4 &model, bool leafMatrices);
+    std::shared_ptr<const TreeSnapshot> takeFinished();
+
+private:
+    void work();
+    std::shared_ptr<const std::vector<glm::mat4>> compactLeaves(const std::shared_ptr<const std::vector<glm::mat4>> &leaves);
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping;
+    uint64_t m_requests;                          // number of the latest request
+    bool m_hasRequest;                            // whether the latest request is still waiting
+    Settings m_requestSettings;
+    glm::mat4 m_requestModel;
+    bool m_requestLeafMatrices;
+    std::shared_ptr<const TreeSnapshot> m_finished; // built and not taken yet
+    std::atomic<bool> m_cancel;                   // set to stop the build in flight
+
+    Tree m_tree; // only used by the worker
+    std::shared_ptr<const std::vector<glm::mat4>> m_compactedLeaves; // leaves compactLeaves() last compacted, only used by the worker
+    std::shared_ptr<const std::vector<glm::mat4>> m_drawnLeaves;     // and what it made of them
+    std::thread m_worker;
+};
+
+#endif // TREEBUILDER_H
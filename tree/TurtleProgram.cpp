@@ -0,0 +1,104 @@
+#include "TurtleProgram.h"
+
+const uint8_t TurtleProgram::FLAG_CONTINUES;
+const uint8_t TurtleProgram::FLAG_VALUES;
+const uint8_t TurtleProgram::FLAG_LOCAL;
+
+TurtleProgram::TurtleProgram()
+{
+
+}
+
+/**
+ * Removes all instructions, keeping the allocated memory for the next program.
+ * @brief TurtleProgram::clear
+ */
+void TurtleProgram::clear() {
+    m_ops.clear();
+    m_values.clear();
+    m_open.clear();
+}
+
+/**
+ * Adds a run of unit moves.
+ * @brief TurtleProgram::forward
+ * @param count number of moves
+ * @param continues whether the branch goes on after the run
+ */
+void TurtleProgram::forward(uint32_t count, bool continues) {
+    m_ops.push_back({ TURTLE_FORWARD, 0, 0, continues ? FLAG_CONTINUES : uint8_t(0), count });
+}
+
+/**
+ * Adds a parametric move.
+ * @brief TurtleProgram::forward
+ * @param step length of the move in branch lengths
+ * @param width width relative to the trunk, negative to keep the current width
+ * @param continues whether the branch goes on after the move
+ */
+void TurtleProgram::forward(float step, float width, bool continues) {
+    uint8_t flags = FLAG_VALUES | (continues ? FLAG_CONTINUES : 0);
+    m_ops.push_back({ TURTLE_FORWARD, 0, 0, flags, static_cast<uint32_t>(m_values.size()) });
+    m_values.push_back(step);
+    m_values.push_back(width);
+}
+
+/**
+ * Adds a turn by the settings angle plus some jitter.
+ * @brief TurtleProgram::turn
+ * @param local whether the axis is one of the turtle's own frame
+ */
+void TurtleProgram::turn(uint8_t axis, int8_t sign, uint32_t jitterDegrees, bool local) {
+    m_ops.push_back({ TURTLE_TURN, axis, sign, local ? FLAG_LOCAL : uint8_t(0), jitterDegrees });
+}
+
+/**
+ * Adds a turn by an explicit angle.
+ * @brief TurtleProgram::turnBy
+ * @param local whether the axis is one of the turtle's own frame
+ */
+void TurtleProgram::turnBy(uint8_t axis, int8_t sign, float degrees, bool local) {
+    uint8_t flags = FLAG_VALUES | (local ? FLAG_LOCAL : 0);
+    m_ops.push_back({ TURTLE_TURN, axis, sign, flags, static_cast<uint32_t>(m_values.size()) });
+    m_values.push_back(degrees);
+}
+
+/**
+ * Opens a branch. Its jump offset is filled in when the matching pop() is added.
+ * @brief TurtleProgram::push
+ */
+void TurtleProgram::push() {
+    m_open.push_back(m_ops.size());
+    m_ops.push_back({ TURTLE_PUSH, 0, 0, 0, 0 });
+}
+
+/**
+ * Closes the innermost open branch and links both ends of it.
+ * @brief TurtleProgram::pop
+ * @param leafAxis index of the axis the leaves at the end of the branch turn on
+ * @return false, adding nothing, if there is no open branch
+ */
+bool TurtleProgram::pop(uint8_t leafAxis) {
+    if (m_open.empty()) {
+        return false;
+    }
+    uint32_t open = m_open.back();
+    m_open.pop_back();
+    m_ops[open].arg = m_ops.size();
+    m_ops.push_back({ TURTLE_POP, leafAxis, 0, 0, open });
+    return true;
+}
+
+/**
+ * Ends the program. Branches that were never closed jump to its end.
+ * @brief TurtleProgram::finish
+ * @return number of branches that were never closed
+ */
+size_t TurtleProgram::finish() {
+    size_t unclosed = m_open.size();
+    for (uint32_t open : m_open) {
+        m_ops[open].arg = m_ops.size();
+    }
+    m_open.clear();
+    return unclosed;
+}
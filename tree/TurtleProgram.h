@@ -0,0 +1,66 @@
+#ifndef TURTLEPROGRAM_H
+#define TURTLEPROGRAM_H
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+enum TurtleOpcode : uint8_t {
+    TURTLE_FORWARD,
+    TURTLE_TURN,
+    TURTLE_PUSH,
+    TURTLE_POP
+};
+
+/**
+ * One turtle instruction. What arg holds depends on the opcode:
+ *   FORWARD  number of moves, or the offset of (step, width) in the values with FLAG_VALUES
+ *   TURN     extra degrees of jitter on top of the settings angle, or the offset of the angle in
+ *            the values with FLAG_VALUES
+ *   PUSH     index of the matching POP (the size of the program if the branch is never closed)
+ *   POP      index of the matching PUSH
+ */
+struct TurtleOp {
+    TurtleOpcode opcode;
+    uint8_t axis;   // TURN: index of the rotation axis, POP: index of the axis the leaves turn on
+    int8_t sign;    // TURN: +1 or -1
+    uint8_t flags;
+    uint32_t arg;
+};
+
+/**
+ * L-system sequence compiled for the turtle. Symbols are resolved once, when the program is
+ * built: forward symbols, turns and brackets become dense opcodes, everything the turtle ignores
+ * is dropped, and brackets are matched so a branch can be skipped or handed off as a whole.
+ */
+class TurtleProgram
+{
+public:
+    // FORWARD: the branch goes on after this move, so a branch it starts is a body rather than a tip.
+    static const uint8_t FLAG_CONTINUES = 1;
+    // arg is an offset into the values instead of an immediate.
+    static const uint8_t FLAG_VALUES = 2;
+    // TURN: turn about an axis of the turtle's own frame rather than a world axis.
+    static const uint8_t FLAG_LOCAL = 4;
+
+    TurtleProgram();
+
+    void clear();
+    void forward(uint32_t count, bool continues);
+    void forward(float step, float width, bool continues);
+    void turn(uint8_t axis, int8_t sign, uint32_t jitterDegrees, bool local);
+    void turnBy(uint8_t axis, int8_t sign, float degrees, bool local);
+    void push();
+    bool pop(uint8_t leafAxis);
+    size_t finish();
+
+    const std::vector<TurtleOp> &ops() const { return m_ops; }
+    const float *values(const TurtleOp &op) const { return m_values.data() + op.arg; }
+    size_t size() const { return m_ops.size(); }
+
+private:
+    std::vector<TurtleOp> m_ops;
+    std::vector<float> m_values;
+    std::vector<uint32_t> m_open; // indices of the PUSHes that are not closed yet
+};
+
+#endif // TURTLEPROGRAM_H
@@ -37,6 +37,19 @@ IntBinding* IntBinding::bindTextbox(QLineEdit *textbox, int &value) {
     return binding;
 }
 
+IntBinding* IntBinding::bindSpinBox(QSpinBox *spinBox, int &value, int minValue, int maxValue) {
+    // Bind the spin box and the value together
+    IntBinding *binding = new IntBinding(value);
+    connect(spinBox, SIGNAL(valueChanged(int)), binding, SLOT(intChanged(int)));
+
+    // Set the range and initial value
+    spinBox->setMinimum(minValue);
+    spinBox->setMaximum(maxValue);
+    spinBox->setValue(value);
+
+    return binding;
+}
+
 void IntBinding::intChanged(int newValue) {
     if (m_value != newValue) {
         m_value = newValue;
@@ -5,6 +5,7 @@
 #include <QVariant>
 #include <QSlider>
 #include <QLineEdit>
+#include <QSpinBox>
 #include <QCheckBox>
 #include <QButtonGroup>
 #include <QRadioButton>
@@ -48,6 +49,8 @@ public:
 
     static IntBinding* bindTextbox(QLineEdit *textbox, int &value);
 
+    static IntBinding* bindSpinBox(QSpinBox *spinBox, int &value, int minValue, int maxValue);
+
 private slots:
     void intChanged(int newValue);
     void stringChanged(QString newValue);
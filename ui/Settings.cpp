@@ -27,6 +27,7 @@ void Settings::loadSettingsOrDefaults() {
     angle = s.value("angle", 25.f).toFloat();
     season = s.value("season", 0).toInt();
     treeOption = s.value("treeOption", 0).toInt();
+    seed = s.value("seed", 0).toInt();
 
 }
 
@@ -36,6 +37,7 @@ void Settings::saveSettings() {
     s.setValue("recursions", recursions);
     s.setValue("angle", angle);
     s.setValue("season", season);
+    s.setValue("seed", seed);
 
 }
 
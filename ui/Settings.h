@@ -35,6 +35,7 @@ struct Settings {
     int season;
     int treeOption;
     bool ifBumpMap;
+    int seed;  // Seed for stochastic rules and angle jitter; the same seed regenerates the same tree.
 
 };
 
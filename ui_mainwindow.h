@@ -23,6 +23,7 @@
 #include <QtWidgets/QRadioButton>
 #include <QtWidgets/QSlider>
 #include <QtWidgets/QSpacerItem>
+#include <QtWidgets/QSpinBox>
 #include <QtWidgets/QVBoxLayout>
 #include <QtWidgets/QWidget>
 
@@ -55,6 +56,8 @@ public:
     QLabel *angleLabel;
     QLineEdit *recursionsTextbox;
     QSlider *leafSizeSlider;
+    QLabel *seedLabel;
+    QSpinBox *seedSpinBox;
     QLabel *seasonLabel;
     QRadioButton *summerRadioButton;
     QRadioButton *fallRadioButton;
@@ -62,6 +65,7 @@ public:
     QRadioButton *springRadioButton;
     QSpacerItem *horizontalSpacer_2;
     QCheckBox *bumpMapCheckbox;
+    QCheckBox *leafTipsCheckbox;
     QSpacerItem *verticalSpacer;
     QFrame *line_2;
     QFrame *line_3;
@@ -207,6 +211,17 @@ public:
 
         sliderGrid->addWidget(leafSizeSlider, 5, 0, 1, 1);
 
+        seedLabel = new QLabel(centralWidget);
+        seedLabel->setObjectName(QString::fromUtf8("seedLabel"));
+
+        sliderGrid->addWidget(seedLabel, 6, 0, 1, 1);
+
+        seedSpinBox = new QSpinBox(centralWidget);
+        seedSpinBox->setObjectName(QString::fromUtf8("seedSpinBox"));
+        seedSpinBox->setMaximum(999999);
+
+        sliderGrid->addWidget(seedSpinBox, 7, 0, 1, 1);
+
         sliderGrid->setColumnStretch(0, 2);
         sliderGrid->setColumnStretch(1, 1);
 
@@ -246,6 +261,12 @@ public:
 
         verticalLayout->addWidget(bumpMapCheckbox);
 
+        leafTipsCheckbox = new QCheckBox(centralWidget);
+        leafTipsCheckbox->setObjectName(QString::fromUtf8("leafTipsCheckbox"));
+        leafTipsCheckbox->setChecked(true);
+
+        verticalLayout->addWidget(leafTipsCheckbox);
+
         verticalSpacer = new QSpacerItem(20, 40, QSizePolicy::Minimum, QSizePolicy::Expanding);
 
         verticalLayout->addItem(verticalSpacer);
@@ -309,12 +330,14 @@ public:
         recursionsLabel->setText(QCoreApplication::translate("MainWindow", "Number of recursions:", nullptr));
         leafSizeLabel->setText(QCoreApplication::translate("MainWindow", "Leaf Size:", nullptr));
         angleLabel->setText(QCoreApplication::translate("MainWindow", "Angle (degrees)", nullptr));
+        seedLabel->setText(QCoreApplication::translate("MainWindow", "Seed:", nullptr));
         seasonLabel->setText(QCoreApplication::translate("MainWindow", "Season:", nullptr));
         summerRadioButton->setText(QCoreApplication::translate("MainWindow", "Summer", nullptr));
         fallRadioButton->setText(QCoreApplication::translate("MainWindow", "Fall", nullptr));
         winterRadioButton->setText(QCoreApplication::translate("MainWindow", "Winter", nullptr));
         springRadioButton->setText(QCoreApplication::translate("MainWindow", "Spring", nullptr));
         bumpMapCheckbox->setText(QCoreApplication::translate("MainWindow", "Bump Mapping", nullptr));
+        leafTipsCheckbox->setText(QCoreApplication::translate("MainWindow", "Expand Leaves on GPU", nullptr));
     } // retranslateUi
 
 };
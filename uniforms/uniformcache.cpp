@@ -0,0 +1,219 @@
+#include "uniformcache.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum UploadKind { UPLOAD_INTS, UPLOAD_FLOATS, UPLOAD_MATRICES };
+
+struct Slot {
+    std::string name;
+    GLint location;
+    unsigned format; // how shadow was uploaded, see getFormat()
+    std::vector<unsigned char> shadow;
+};
+
+struct Program {
+    GLuint id;
+    std::vector<Slot> slots;
+};
+
+// A few programs with a few uniforms each, so they are simply searched in order
+std::vector<Program> s_programs;
+UniformUploads s_frame = { 0, 0 };
+UniformUploads s_lastFrame = { 0, 0 };
+
+unsigned getFormat(UploadKind kind, int components, GLboolean transpose) {
+    return (kind << 8) | (components << 1) | (transpose ? 1 : 0);
+}
+
+Program *findProgram(GLuint program) {
+    for (Program &p : s_programs) {
+        if (p.id == program) return &p;
+    }
+    return 0;
+}
+
+/**
+ * Finds out whether value has to be uploaded to the uniform and where, and if so remembers it as
+ * the value the program has.
+ */
+bool prepareUpload(GLuint program, const char *name, unsigned format, const void *value, size_t bytes,
+                   GLint &location) {
+    Program *p = findProgram(program);
+    if (!p) {
+        location = glGetUniformLocation(program, name);
+        s_frame.uploaded++;
+        return true;
+    }
+    for (Slot &slot : p->slots) {
+        if (strcmp(slot.name.c_str(), name)) continue;
+
+        if (slot.format == format && slot.shadow.size() == bytes && !memcmp(slot.shadow.data(), value, bytes)) {
+            s_frame.skipped++;
+            return false;
+        }
+        slot.format = format;
+        slot.shadow.assign(static_cast<const unsigned char *>(value), static_cast<const unsigned char *>(value) + bytes);
+        location = slot.location;
+        s_frame.uploaded++;
+        return true;
+    }
+    return false; // not used by the program
+}
+
+}
+
+/**
+ * Looks up the locations of the active uniforms of a linked program. A program that is linked
+ * again, or a new one that got the id of a deleted one, starts over with no values known.
+ * @brief UniformCache::addProgram
+ */
+void UniformCache::addProgram(GLuint program)
+{
+    removeProgram(program);
+    Program p;
+    p.id = program;
+
+    GLint numActiveUniforms = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numActiveUniforms);
+    std::vector<GLchar> nameData(256);
+    for (int unif = 0; unif < numActiveUniforms; unif++) {
+        GLint arraySize = 0;
+        GLenum type = 0;
+        GLsizei actualLength = 0;
+        glGetActiveUniform(program, unif, nameData.size(), &actualLength, &arraySize, &type, &nameData[0]);
+        std::string name(&nameData[0], actualLength);
+        // Arrays are listed by their first element
+        if (name.size() > 3 && !name.compare(name.size() - 3, 3, "[0]")) {
+            name.resize(name.size() - 3);
+        }
+
+        Slot slot;
+        slot.location = glGetUniformLocation(program, name.c_str());
+        if (slot.location < 0) continue; // built in
+        slot.name = name;
+        slot.format = 0;
+        p.slots.push_back(slot);
+    }
+    s_programs.push_back(p);
+}
+
+/**
+ * @brief UniformCache::removeProgram
+ */
+void UniformCache::removeProgram(GLuint program)
+{
+    for (size_t i = 0; i < s_programs.size(); i++) {
+        if (s_programs[i].id == program) {
+            s_programs.erase(s_programs.begin() + i);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief UniformCache::location
+ */
+GLint UniformCache::location(GLuint program, const char *name)
+{
+    Program *p = findProgram(program);
+    if (!p) return glGetUniformLocation(program, name);
+
+    for (const Slot &slot : p->slots) {
+        if (!strcmp(slot.name.c_str(), name)) return slot.location;
+    }
+    return -1;
+}
+
+/**
+ * Sets an int, ivec2, ivec3 or ivec4 uniform, or count of them for an array.
+ * @brief UniformCache::setInts
+ */
+bool UniformCache::setInts(GLuint program, const char *name, const GLint *values, int components, int count)
+{
+    GLint location;
+    if (!prepareUpload(program, name, getFormat(UPLOAD_INTS, components, GL_FALSE), values,
+                       sizeof(GLint) * components * count, location)) {
+        return false;
+    }
+    switch (components) {
+    case 1: glUniform1iv(location, count, values); break;
+    case 2: glUniform2iv(location, count, values); break;
+    case 3: glUniform3iv(location, count, values); break;
+    case 4: glUniform4iv(location, count, values); break;
+    }
+    return true;
+}
+
+/**
+ * Sets a float, vec2, vec3 or vec4 uniform, or count of them for an array.
+ * @brief UniformCache::setFloats
+ */
+bool UniformCache::setFloats(GLuint program, const char *name, const GLfloat *values, int components, int count)
+{
+    GLint location;
+    if (!prepareUpload(program, name, getFormat(UPLOAD_FLOATS, components, GL_FALSE), values,
+                       sizeof(GLfloat) * components * count, location)) {
+        return false;
+    }
+    switch (components) {
+    case 1: glUniform1fv(location, count, values); break;
+    case 2: glUniform2fv(location, count, values); break;
+    case 3: glUniform3fv(location, count, values); break;
+    case 4: glUniform4fv(location, count, values); break;
+    }
+    return true;
+}
+
+/**
+ * Sets a mat2, mat3 or mat4 uniform, or count of them for an array.
+ * @brief UniformCache::setMatrices
+ * @param size number of rows and columns
+ */
+bool UniformCache::setMatrices(GLuint program, const char *name, const GLfloat *values, int size, int count,
+                               GLboolean transpose)
+{
+    GLint location;
+    if (!prepareUpload(program, name, getFormat(UPLOAD_MATRICES, size, transpose), values,
+                       sizeof(GLfloat) * size * size * count, location)) {
+        return false;
+    }
+    switch (size) {
+    case 2: glUniformMatrix2fv(location, count, transpose, values); break;
+    case 3: glUniformMatrix3fv(location, count, transpose, values); break;
+    case 4: glUniformMatrix4fv(location, count, transpose, values); break;
+    }
+    return true;
+}
+
+/**
+ * Sets an int, bool or sampler uniform.
+ * @brief UniformCache::setInt
+ */
+bool UniformCache::setInt(GLuint program, const char *name, GLint value)
+{
+    return setInts(program, name, &value, 1, 1);
+}
+
+/**
+ * Keeps the counts of the frame that ended for lastFrame() and starts counting again.
+ * @brief UniformCache::beginFrame
+ */
+void UniformCache::beginFrame()
+{
+    s_lastFrame = s_frame;
+    s_frame.uploaded = 0;
+    s_frame.skipped = 0;
+}
+
+/**
+ * @brief UniformCache::lastFrame
+ * @return the uploads and skipped uploads between the last two calls to beginFrame()
+ */
+UniformUploads UniformCache::lastFrame()
+{
+    return s_lastFrame;
+}
@@ -0,0 +1,40 @@
+#ifndef UNIFORMCACHE_H
+#define UNIFORMCACHE_H
+
+#include "GL/glew.h"
+
+/**
+ * Uniform uploads of one frame, see UniformCache::beginFrame().
+ */
+struct UniformUploads {
+    unsigned uploaded;
+    unsigned skipped; // the program already had the value
+};
+
+/**
+ * Locations of the uniforms of every linked program, looked up once when the program is linked,
+ * with a copy of the value last uploaded to each. Uploads that would not change the value the
+ * program already has are skipped. The upload functions work on the bound program, and only know
+ * the values that went through them, so every uniform they set should always be set through them.
+ */
+namespace UniformCache
+{
+    // Called by ResourceLoader once a program is linked, and before it is deleted
+    void addProgram(GLuint program);
+    void removeProgram(GLuint program);
+
+    // -1 if the program has no such active uniform
+    GLint location(GLuint program, const char *name);
+
+    // These return whether they uploaded. Programs that were never added are always uploaded to.
+    bool setInts(GLuint program, const char *name, const GLint *values, int components, int count);
+    bool setFloats(GLuint program, const char *name, const GLfloat *values, int components, int count);
+    bool setMatrices(GLuint program, const char *name, const GLfloat *values, int size, int count, GLboolean transpose);
+    bool setInt(GLuint program, const char *name, GLint value);
+
+    // Starts counting the uploads of a new frame
+    void beginFrame();
+    UniformUploads lastFrame();
+}
+
+#endif // UNIFORMCACHE_H
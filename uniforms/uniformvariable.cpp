@@ -1,7 +1,9 @@
 #include "uniformvariable.h"
 
 #include "glwidget.h"
+#include "uniformcache.h"
 #include <QFileInfo>
+#include <iostream>
 
 GLuint UniformVariable::s_numTextures = 2;
 QList<GLuint> UniformVariable::s_faceTextures;
@@ -539,47 +541,99 @@ bool UniformVariable::parse(const QString &value, bool verifyOnly)
     return true;
 }
 
+/**
+ * Sets a mat4 uniform straight from a matrix, without going through text. The value is kept
+ * the way parse() keeps it, row by row, and uploaded transposed by setValue().
+ * @brief UniformVariable::setMat4
+ * @return whether the value changed
+ */
+bool UniformVariable::setMat4(const glm::mat4 &matrix)
+{
+    if (type != TYPE_MAT4) {
+        std::cout << "setMat4 on " << getAsciiName() << ", which is a " << typeName().toStdString() << std::endl;
+        return false;
+    }
+    GLfloat rows[16];
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            rows[r * 4 + c] = matrix[c][r];
+        }
+    }
+    return setFloats(rows, 16);
+}
+
+/**
+ * Sets the float components of the uniform, as parse() would from the same numbers separated by
+ * commas. Nothing is allocated, so it can be called on every draw.
+ * @brief UniformVariable::setFloats
+ * @return whether the value changed
+ */
+bool UniformVariable::setFloats(const GLfloat *values, int count)
+{
+    if (!isFloatValue() || isIntValue() || type == TYPE_TIME || count != elements) {
+        std::cout << "setFloats with " << count << " values on " << getAsciiName() << ", which is a "
+                  << typeName().toStdString() << std::endl;
+        return false;
+    }
+    if (copyFrom == this && maxSizeUsed == 1 && strVal.isEmpty()
+            && !memcmp(floatVal, values, count * sizeof(GLfloat))) {
+        return false;
+    }
+    memcpy(floatVal, values, count * sizeof(GLfloat));
+    copyFrom = this;
+    if (!strVal.isEmpty()) {
+        strVal.clear();
+    }
+    maxSizeUsed = 1;
+    return true;
+}
+
+/**
+ * Uploads the value to the bound shader. Uploads go through UniformCache, which knows where the
+ * uniform is and skips values the shader already has.
+ * @brief UniformVariable::setValue
+ */
 void UniformVariable::setValue(QGLShaderProgram *shader) const
 {
+    GLuint program = shader->programId();
     switch (type) {
     case TYPE_INT:
     case TYPE_BOOL:
-        shader->setUniformValue(getAsciiName(), copyFrom->intVal[0]);
+        UniformCache::setInt(program, getAsciiName(), copyFrom->intVal[0]);
         break;
 
     case TYPE_INT2:
     case TYPE_INT3:
     case TYPE_INT4:
-        shader->setUniformValueArray(getAsciiName(), copyFrom->floatValue(), arraySize, copyFrom->elements);
+        UniformCache::setInts(program, getAsciiName(), copyFrom->intValue(), copyFrom->elements, arraySize);
         break;
 
     case TYPE_FLOAT:
-        if (copyFrom->type == TYPE_TIME)
-            shader->setUniformValue(getAsciiName(), copyFrom->timeValue());
-        else
-            shader->setUniformValueArray(getAsciiName(), copyFrom->floatValue(), arraySize, copyFrom->elements);
-        break;
-
     case TYPE_TIME:
-        shader->setUniformValue(getAsciiName(), copyFrom->timeValue());
+        if (copyFrom->type == TYPE_TIME) {
+            GLfloat time = copyFrom->timeValue();
+            UniformCache::setFloats(program, getAsciiName(), &time, 1, 1);
+        } else {
+            UniformCache::setFloats(program, getAsciiName(), copyFrom->floatValue(), copyFrom->elements, arraySize);
+        }
         break;
 
     case TYPE_FLOAT2:
     case TYPE_FLOAT3:
     case TYPE_FLOAT4:
-        shader->setUniformValueArray(getAsciiName(), copyFrom->floatValue(), arraySize, copyFrom->elements);
+        UniformCache::setFloats(program, getAsciiName(), copyFrom->floatValue(), copyFrom->elements, arraySize);
         break;
 
     case TYPE_MAT2:
-        gl->glUniformMatrix2fv(gl->glGetUniformLocation(shader->programId(), getAsciiName()), arraySize, GL_TRUE, copyFrom->floatValue());
+        UniformCache::setMatrices(program, getAsciiName(), copyFrom->floatValue(), 2, arraySize, GL_TRUE);
         break;
 
     case TYPE_MAT3:
-        gl->glUniformMatrix3fv(gl->glGetUniformLocation(shader->programId(), getAsciiName()), arraySize, GL_TRUE, copyFrom->floatValue());
+        UniformCache::setMatrices(program, getAsciiName(), copyFrom->floatValue(), 3, arraySize, GL_TRUE);
         break;
 
     case TYPE_MAT4:
-        gl->glUniformMatrix4fv(gl->glGetUniformLocation(shader->programId(), getAsciiName()), arraySize, GL_TRUE, copyFrom->floatValue());
+        UniformCache::setMatrices(program, getAsciiName(), copyFrom->floatValue(), 4, arraySize, GL_TRUE);
         break;
 
     case TYPE_TEX1D:
@@ -587,15 +641,15 @@ void UniformVariable::setValue(QGLShaderProgram *shader) const
 
         gl->glActiveTexture(GL_TEXTURE0 + copyFrom->texOffset);
         glBindTexture(GL_TEXTURE_2D, copyFrom->texID);
-        gl->glUniform1i(gl->glGetUniformLocation(shader->programId(), copyFrom->getAsciiName()), copyFrom->texOffset);
-        shader->setUniformValue(getAsciiName(), copyFrom->texOffset);
+        UniformCache::setInt(program, copyFrom->getAsciiName(), copyFrom->texOffset);
+        UniformCache::setInt(program, getAsciiName(), copyFrom->texOffset);
 
         gl->glActiveTexture(GL_TEXTURE0);
         break;
     case TYPE_TEXCUBE:
         gl->glActiveTexture(GL_TEXTURE0 + copyFrom->texOffset);
         glBindTexture(GL_TEXTURE_CUBE_MAP, copyFrom->texID);
-        gl->glUniform1i(gl->glGetUniformLocation(shader->programId(), getAsciiName()), copyFrom->texOffset);
+        UniformCache::setInt(program, getAsciiName(), copyFrom->texOffset);
 
         gl->glActiveTexture(GL_TEXTURE0);
         break;
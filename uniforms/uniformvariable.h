@@ -7,7 +7,7 @@
 #include <QOpenGLFunctions>
 
 #include "lib/common.h"
-
+#include "glm/glm.hpp"
 
 class UniformVariable
 {
@@ -90,6 +90,8 @@ public:
 
     QString toString() const;
     bool parse(const QString &value, bool verifyOnly = false);
+    bool setMat4(const glm::mat4 &matrix);
+    bool setFloats(const GLfloat *values, int count);
 
     void setValue(QGLShaderProgram *shader) const;
 